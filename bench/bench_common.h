@@ -0,0 +1,89 @@
+#ifndef MEMORYPOOL_BENCH_COMMON_H
+#define MEMORYPOOL_BENCH_COMMON_H
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// 统计当前线程用户态执行的指令数，内核不允许使用 perf event 时 available() 为 false
+class InstructionCounter {
+public:
+    InstructionCounter() {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        _fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~InstructionCounter() {
+        if(_fd >= 0) close(_fd);
+    }
+
+    InstructionCounter(const InstructionCounter&) = delete;
+    InstructionCounter& operator=(const InstructionCounter&) = delete;
+
+    [[nodiscard]] bool available() const {
+        return _fd >= 0;
+    }
+
+    void start() {
+        if(_fd < 0) return;
+        ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    long long stop() {
+        if(_fd < 0) return -1;
+        ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long cnt = 0;
+        if(read(_fd, &cnt, sizeof(cnt)) != sizeof(cnt)) return -1;
+        return cnt;
+    }
+private:
+    int _fd;
+};
+
+// 阻止编译器把结果优化掉
+template<typename T>
+inline void do_not_optimize(T const& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/* 执行 iters 次 f，每次包含 ops 个操作，输出每个操作的耗时和指令数
+ * 指令数包含循环本身的开销（每轮几条指令）
+ */
+template<typename F>
+void run_bench(const char* name, size_t iters, size_t ops, F&& f) {
+    // 预热：填充缓存、构造各层单例
+    for(size_t i = 0; i < iters / 10 + 1; ++i) {
+        f();
+    }
+
+    InstructionCounter counter;
+    auto begin = std::chrono::steady_clock::now();
+    counter.start();
+    for(size_t i = 0; i < iters; ++i) {
+        f();
+    }
+    long long insns = counter.stop();
+    auto end = std::chrono::steady_clock::now();
+
+    double total_ops = static_cast<double>(iters * ops);
+    double ns = std::chrono::duration<double, std::nano>(end - begin).count() / total_ops;
+    if(insns >= 0) {
+        printf("%-40s %8.2f ns/op %8.2f insns/op\n", name, ns, static_cast<double>(insns) / total_ops);
+    } else {
+        printf("%-40s %8.2f ns/op %8s insns/op\n", name, ns, "n/a");
+    }
+}
+
+
+#endif //MEMORYPOOL_BENCH_COMMON_H
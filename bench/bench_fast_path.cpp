@@ -0,0 +1,49 @@
+#include "bench_common.h"
+#include "memory_pool.h"
+
+/* 测量申请/释放快路径：同一个 object 反复申请释放，始终命中 thread cache 链表
+ * 以 insns/op 衡量快路径长度（需要内核允许 perf_event_open）
+ */
+int main() {
+    constexpr size_t iters = 10000000;
+    constexpr size_t size_class = SizeMap::size_class_of<64>();
+
+    ThreadCache* tc = ThreadCache::get();
+    run_bench("ThreadCache::alloc + dealloc", iters, 2, [tc]() {
+        void* ptr = tc->alloc(size_class);
+        do_not_optimize(ptr);
+        tc->dealloc(size_class, ptr);
+    });
+
+    run_bench("mp_malloc + mp_free_sized", iters, 2, []() {
+        void* ptr = mp_malloc(64);
+        do_not_optimize(ptr);
+        mp_free_sized(ptr, 64);
+    });
+
+    run_bench("mp_malloc + mp_free", iters, 2, []() {
+        void* ptr = mp_malloc(64);
+        do_not_optimize(ptr);
+        mp_free(ptr);
+    });
+
+    constexpr size_t batch_size = 1000;
+    static void* batch[batch_size];
+    run_bench("mp_malloc + mp_free_sized x1000", iters / batch_size, 2 * batch_size, []() {
+        for(auto& ptr : batch) {
+            ptr = mp_malloc(64);
+        }
+        do_not_optimize(batch);
+        for(auto ptr : batch) {
+            mp_free_sized(ptr, 64);
+        }
+    });
+
+    run_bench("mp_alloc_batch + mp_free_batch x1000", iters / batch_size, 2 * batch_size, []() {
+        mp_alloc_batch(64, batch, batch_size);
+        do_not_optimize(batch);
+        mp_free_batch(64, batch, batch_size);
+    });
+
+    return 0;
+}
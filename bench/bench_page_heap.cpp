@@ -0,0 +1,60 @@
+#include <vector>
+#include <random>
+#include "bench_common.h"
+#include "span.h"
+#include "bitmap.h"
+
+/* 对比 page heap 中查找第一个足够大的非空 small span 链表的两种方式：
+ * 逐个检查链表是否为空，与在占用位图上用 count-trailing-zeros 查找
+ * 模拟碎片化的 heap：128 个链表中只有少数大页数的链表非空，小请求需要向后扫描很远
+ */
+namespace {
+constexpr size_t num_lists = 128;
+constexpr size_t num_queries = 1024;
+
+size_t linear_scan(const SpanList* lists, size_t start) {
+    for(size_t i = start; i < num_lists; ++i) {
+        if(!lists[i].empty()) return i;
+    }
+    return num_lists;
+}
+}
+
+int main() {
+    static SpanList lists[num_lists];
+    Bitmap<num_lists> nonempty;
+    std::vector<Span> spans;
+    spans.reserve(num_lists);
+    std::mt19937_64 rng(42);
+    for(size_t i = 0; i < num_lists; ++i) {
+        // 页数越小越可能已被切光
+        if(rng() % num_lists < i / 4) {
+            spans.emplace_back(reinterpret_cast<void*>((i + 1) << 20), i + 1);
+            lists[i].prepend(&spans.back());
+            nonempty.set(i);
+        }
+    }
+
+    // 多数请求是小页数
+    std::vector<size_t> queries(num_queries);
+    for(auto& q : queries) {
+        q = rng() % 8;
+    }
+
+    size_t sink = 0;
+    run_bench("linear scan", 10000, num_queries, [&]() {
+        for(size_t q : queries) {
+            sink += linear_scan(lists, q);
+        }
+        do_not_optimize(sink);
+    });
+
+    run_bench("bitmap find_next", 10000, num_queries, [&]() {
+        for(size_t q : queries) {
+            sink += nonempty.find_next(q);
+        }
+        do_not_optimize(sink);
+    });
+
+    return 0;
+}
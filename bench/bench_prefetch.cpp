@@ -0,0 +1,61 @@
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <sys/mman.h>
+#include "bench_common.h"
+#include "free_list.h"
+
+/* 测量链表在 cache 冷启动下的吞吐：object 打乱后分布在远大于 LLC 的区域中，
+ * 每次 pop 读取的 next 几乎都会 cache miss
+ * bench_prefetch_off 是关闭预取编译的同一份代码，两者对比即为预取的效果
+ */
+namespace {
+constexpr size_t object_size = 64;
+constexpr size_t num_objects = size_t(1) << 21;
+constexpr size_t chunk = 32;
+
+// 模拟调用方拿到 object 后的少量工作
+inline void touch(void* ptr) {
+    auto p = static_cast<size_t*>(ptr);
+    p[1] = p[1] * 31 + 7;
+    p[7] = p[1] ^ p[7];
+}
+}
+
+int main() {
+    void* arena = mmap(nullptr, num_objects * object_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(arena == MAP_FAILED) return 1;
+    std::vector<void*> objects(num_objects);
+    for(size_t i = 0; i < num_objects; ++i) {
+        objects[i] = static_cast<char*>(arena) + i * object_size;
+    }
+    std::shuffle(objects.begin(), objects.end(), std::mt19937_64(42));
+
+    FreeList list;
+    list.push_batch(objects.data(), num_objects);
+
+    std::vector<void*> popped(num_objects);
+    run_bench("FreeList pop + push_batch", 5, 2 * num_objects, [&]() {
+        for(size_t i = 0; i < num_objects; ++i) {
+            popped[i] = list.pop();
+            touch(popped[i]);
+        }
+        list.push_batch(popped.data(), num_objects);
+    });
+
+    run_bench("FreeList pop_batch + push_batch x32", 5, 2 * num_objects, [&]() {
+        for(size_t i = 0; i < num_objects; i += chunk) {
+            list.pop_batch(popped.data() + i, chunk);
+            for(size_t j = i; j < i + chunk; ++j) {
+                touch(popped[j]);
+            }
+        }
+        for(size_t i = 0; i < num_objects; i += chunk) {
+            list.push_batch(popped.data() + i, chunk);
+        }
+    });
+
+    munmap(arena, num_objects * object_size);
+    return 0;
+}
@@ -0,0 +1,122 @@
+#ifndef MEMORYPOOL_BOOTSTRAP_ALLOC_H
+#define MEMORYPOOL_BOOTSTRAP_ALLOC_H
+#include <mutex>
+#include <cerrno>
+#include <cstdint>
+#include <sys/mman.h>
+#include "free_list.h"
+#include "singleton.h"
+
+/* 替换 libc malloc 后的兜底分配器，不依赖 pool 的任何一层：
+ * 服务 pool 内部的重入申请，以及 pool 销毁之后的申请
+ * 从一块预留的地址空间中按 2 的幂切块，释放后挂到对应链表上复用
+ */
+class BootstrapAlloc {
+public:
+    // align 不是 2 的幂时设置 errno 为 EINVAL 并返回 nullptr
+    void* alloc(size_t n, size_t align = _min_align);
+    void dealloc(void* ptr);
+    [[nodiscard]] size_t usable_size(void* ptr) const;
+
+    [[nodiscard]] bool contains(void* ptr) const {
+        return ptr >= _start && ptr < _end;
+    }
+
+    friend Singleton<BootstrapAlloc>;
+    BootstrapAlloc(const BootstrapAlloc&) = delete;
+    BootstrapAlloc(const BootstrapAlloc&&) = delete;
+    BootstrapAlloc& operator=(const BootstrapAlloc&) = delete;
+    BootstrapAlloc& operator=(const BootstrapAlloc&&) = delete;
+private:
+    BootstrapAlloc();
+    // 进程退出时仍可能被使用，不做任何释放
+    ~BootstrapAlloc() = default;
+
+    // 紧挨在返回地址之前，记录所在块的大小以及返回地址相对块起始的偏移
+    struct Header {
+        uint32_t shift;
+        uint32_t offset;
+        uint64_t padding;
+    };
+
+    static Header* header(void* ptr) {
+        return reinterpret_cast<Header*>(ptr) - 1;
+    }
+
+private:
+    constexpr static size_t _min_align = sizeof(Header);
+    constexpr static size_t _min_shift = 5;
+    constexpr static size_t _max_shift = 30;
+    constexpr static size_t _region_size = 1ll << _max_shift;
+    char* _start;
+    char* _end;
+    char* _cur;
+    FreeList _lists[_max_shift + 1];
+    mutable std::mutex _lock;
+};
+
+BootstrapAlloc::BootstrapAlloc() : _start(nullptr), _end(nullptr), _cur(nullptr) {
+    // 只预留地址空间，物理页在第一次访问时才分配
+    void* ptr = mmap(nullptr, _region_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(ptr == MAP_FAILED) return;
+    _start = _cur = static_cast<char*>(ptr);
+    _end = _start + _region_size;
+}
+
+void* BootstrapAlloc::alloc(size_t n, size_t align) {
+    // 与 mp_aligned_alloc 一致，对齐要求必须是 2 的幂
+    if(align == 0 || (align & (align - 1)) != 0) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    align = std::max(align, _min_align);
+    if(n > _region_size || align > _region_size) return nullptr;
+
+    // 块内需要放下 header、对齐填充以及 n 字节
+    size_t need = n + align;
+    size_t shift = _min_shift;
+    while((size_t(1) << shift) < need) {
+        ++shift;
+    }
+    if(shift > _max_shift) return nullptr;
+
+    char* block = nullptr;
+    {
+        std::lock_guard<std::mutex> lg(_lock);
+        auto& list = _lists[shift];
+        if(!list.empty()) {
+            block = static_cast<char*>(list.pop());
+        } else if(_end - _cur >= (1ll << shift)) {
+            block = _cur;
+            _cur += size_t(1) << shift;
+        }
+    }
+    if(block == nullptr) return nullptr;
+
+    auto res = reinterpret_cast<size_t>(block) + sizeof(Header);
+    res = (res + align - 1) & ~(align - 1);
+    void* ptr = reinterpret_cast<void*>(res);
+    header(ptr)->shift = shift;
+    header(ptr)->offset = static_cast<uint32_t>(static_cast<char*>(ptr) - block);
+    return ptr;
+}
+
+void BootstrapAlloc::dealloc(void* ptr) {
+    Header* h = header(ptr);
+    size_t shift = h->shift;
+    char* block = static_cast<char*>(ptr) - h->offset;
+
+    std::lock_guard<std::mutex> lg(_lock);
+    _lists[shift].push(block);
+}
+
+size_t BootstrapAlloc::usable_size(void* ptr) const {
+    Header* h = header(ptr);
+    return (size_t(1) << h->shift) - h->offset;
+}
+
+using SingleBootstrapAlloc = Singleton<BootstrapAlloc>;
+
+
+#endif //MEMORYPOOL_BOOTSTRAP_ALLOC_H
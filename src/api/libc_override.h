@@ -0,0 +1,146 @@
+#ifndef MEMORYPOOL_LIBC_OVERRIDE_H
+#define MEMORYPOOL_LIBC_OVERRIDE_H
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <malloc.h>
+#include "memory_pool.h"
+#include "bootstrap_alloc.h"
+#include "reentry_guard.h"
+#include "cpu_cache.h"
+#include "central_cache.h"
+#include "page_heap.h"
+#include "large_cache.h"
+
+/* 替换 glibc 的 malloc 系列函数，配合 LD_PRELOAD 使用
+ * 以下情况不能进入 pool，改由 BootstrapAlloc 服务：
+ *   1. pool 内部申请内存导致的重入（此时可能持有 pool 的锁）
+ *   2. pool 已经被 destroy
+ */
+#define MP_VISIBLE __attribute__((visibility("default")))
+#define MP_EXPORT extern "C" MP_VISIBLE
+
+static bool mp_pool_destroyed() {
+    return SingleCpuCache::destroyed() || SingleCentralCahce::destroyed() || SingleLargeCache::destroyed() ||
+           SinglePageHeap::destroyed();
+}
+
+static bool mp_bypass() {
+    return ReentryGuard::active() || mp_pool_destroyed();
+}
+
+MP_EXPORT void* malloc(size_t n) noexcept {
+    if(mp_bypass()) {
+        return SingleBootstrapAlloc::get_instance().alloc(n);
+    }
+    ReentryGuard guard;
+    return mp_malloc(n);
+}
+
+MP_EXPORT void free(void* ptr) noexcept {
+    if(ptr == nullptr) return;
+    auto& ba = SingleBootstrapAlloc::get_instance();
+    if(ba.contains(ptr)) {
+        ba.dealloc(ptr);
+        return;
+    }
+    // pool 已销毁，其中的内存也随之失效
+    if(mp_pool_destroyed()) return;
+    ReentryGuard guard;
+    mp_free(ptr);
+}
+
+MP_EXPORT void* calloc(size_t num, size_t size) noexcept {
+    if(!mp_bypass()) {
+        ReentryGuard guard;
+        return mp_calloc(num, size);
+    }
+
+    if(size != 0 && num > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    void* ptr = SingleBootstrapAlloc::get_instance().alloc(num * size);
+    if(ptr != nullptr) {
+        memset(ptr, 0, num * size);
+    }
+    return ptr;
+}
+
+MP_EXPORT void* realloc(void* ptr, size_t n) noexcept {
+    auto& ba = SingleBootstrapAlloc::get_instance();
+    if(ptr == nullptr || !ba.contains(ptr)) {
+        if(!mp_bypass()) {
+            ReentryGuard guard;
+            return mp_realloc(ptr, n);
+        }
+        // pool 已销毁，无法得知原 object 大小
+        if(ptr != nullptr) {
+            errno = ENOMEM;
+            return nullptr;
+        }
+        return ba.alloc(n);
+    }
+
+    // 从 bootstrap 迁移出来，新空间按当前状态决定由谁分配
+    if(n == 0) {
+        ba.dealloc(ptr);
+        return nullptr;
+    }
+    void* res = malloc(n);
+    if(res == nullptr) return nullptr;
+    memcpy(res, ptr, std::min(n, ba.usable_size(ptr)));
+    ba.dealloc(ptr);
+    return res;
+}
+
+MP_EXPORT void* aligned_alloc(size_t align, size_t n) noexcept {
+    if(mp_bypass()) {
+        return SingleBootstrapAlloc::get_instance().alloc(n, align);
+    }
+    ReentryGuard guard;
+    return mp_aligned_alloc(align, n);
+}
+
+MP_EXPORT void* memalign(size_t align, size_t n) noexcept {
+    return aligned_alloc(align, n);
+}
+
+MP_EXPORT int posix_memalign(void** res, size_t align, size_t n) noexcept {
+    if(align % sizeof(void*) != 0 || (align & (align - 1)) != 0 || align == 0) {
+        return EINVAL;
+    }
+    void* ptr = aligned_alloc(align, n);
+    if(ptr == nullptr) {
+        return ENOMEM;
+    }
+    *res = ptr;
+    return 0;
+}
+
+// Page::SIZE 是系统页大小的整数倍，按 Page::SIZE 对齐同样满足页对齐
+MP_EXPORT void* valloc(size_t n) noexcept {
+    return aligned_alloc(Page::SIZE, n);
+}
+
+MP_EXPORT void* pvalloc(size_t n) noexcept {
+    if(n > SIZE_MAX - Page::SIZE) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    n = (std::max(n, size_t(1)) + Page::SIZE - 1) & ~(Page::SIZE - 1);
+    return aligned_alloc(Page::SIZE, n);
+}
+
+MP_EXPORT size_t malloc_usable_size(void* ptr) noexcept {
+    if(ptr == nullptr) return 0;
+    auto& ba = SingleBootstrapAlloc::get_instance();
+    if(ba.contains(ptr)) {
+        return ba.usable_size(ptr);
+    }
+    if(mp_pool_destroyed()) return 0;
+    return mp_malloc_usable_size(ptr);
+}
+
+
+#endif //MEMORYPOOL_LIBC_OVERRIDE_H
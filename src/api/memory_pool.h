@@ -0,0 +1,283 @@
+#ifndef MEMORYPOOL_MEMORY_POOL_H
+#define MEMORYPOOL_MEMORY_POOL_H
+#include <cerrno>
+#include <cstring>
+#include <cassert>
+#include "size_map.h"
+#include "span.h"
+#include "page.h"
+#include "page_map.h"
+#include "page_heap.h"
+#include "large_cache.h"
+#include "thread_cache.h"
+#include "cpu_cache.h"
+#include "attributes.h"
+
+// 对外的 malloc 系列接口，调用方只需关心字节数，不再需要自己维护 size class
+void* mp_malloc(size_t n);
+void mp_free(void* ptr);
+// n 为申请时的字节数，可直接算出 size class，省去 PageMap 查找
+void mp_free_sized(void* ptr, size_t n);
+void* mp_calloc(size_t num, size_t size);
+void* mp_realloc(void* ptr, size_t n);
+void* mp_aligned_alloc(size_t align, size_t n);
+size_t mp_malloc_usable_size(void* ptr);
+/* 批量申请/释放 n 个 size 字节的 object，省去逐个申请的开销
+ * mp_alloc_batch 返回实际申请到的个数，不足 n 时设置 errno
+ * mp_free_batch 要求 batch 中的 object 都是以同样的 size 申请的
+ */
+size_t mp_alloc_batch(size_t size, void** batch, size_t n);
+void mp_free_batch(size_t size, void** batch, size_t n);
+
+// 超过 SizeMap::max_size() 的请求，经 large cache 申请整页 span
+static void* mp_alloc_large(size_t n, size_t align) {
+    // page heap 返回的 span 按页对齐，对齐要求更大时多申请一些页用于调整起始地址
+    size_t extra = align > Page::SIZE ? align - Page::SIZE : 0;
+    if(n > SIZE_MAX - extra - Page::SIZE) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    size_t num_pages = (n + extra + Page::SIZE - 1) >> Page::SHIFT;
+
+    Span* span = SingleLargeCache::get_instance().alloc(num_pages, n);
+    if(span == nullptr) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    auto start = reinterpret_cast<size_t>(span->start_addr());
+    return reinterpret_cast<void*>((start + align - 1) & ~(align - 1));
+}
+
+MP_NOINLINE static void* mp_alloc_small_slow(size_t size_class) {
+    void* ptr = nullptr;
+    auto& cpu = SingleCpuCache::get_instance();
+    if(cpu.active()) {
+        ptr = cpu.alloc(size_class);
+    } else if(ThreadCache* tc = ThreadCache::get(); tc != nullptr) {
+        ptr = tc->alloc(size_class);
+    } else {
+        // 线程已经析构了 thread cache，直接从 central cache 拿一个 object
+        SingleCentralCahce::get_instance().alloc(size_class, &ptr, 1);
+    }
+    if(ptr == nullptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+/* 快路径：线程已经有 thread cache（说明没有启用 per-cpu cache），
+ * 或者已确认可以使用 per-cpu cache 时，直接从中申请
+ * 第一次申请以及线程退出阶段都走慢路径
+ */
+MP_ALWAYS_INLINE static void* mp_alloc_small(size_t size_class) {
+    void* ptr;
+    if(ThreadCache* tc = ThreadCache::current(); MP_LIKELY(tc != nullptr)) {
+        ptr = tc->alloc(size_class);
+    } else if(struct rseq* rs = CpuCache::current(); rs != nullptr) {
+        ptr = SingleCpuCache::get_instance().alloc(rs, size_class);
+    } else {
+        return mp_alloc_small_slow(size_class);
+    }
+    if(MP_LIKELY(ptr != nullptr)) return ptr;
+    errno = ENOMEM;
+    return nullptr;
+}
+
+MP_NOINLINE static void mp_dealloc_small_slow(size_t size_class, void* ptr) {
+    auto& cpu = SingleCpuCache::get_instance();
+    if(cpu.active()) {
+        cpu.dealloc(size_class, ptr);
+    } else if(ThreadCache* tc = ThreadCache::get(); tc != nullptr) {
+        tc->dealloc(size_class, ptr);
+    } else {
+        SingleCentralCahce::get_instance().dealloc(size_class, &ptr, 1);
+    }
+}
+
+MP_ALWAYS_INLINE static void mp_dealloc_small(size_t size_class, void* ptr) {
+    if(ThreadCache* tc = ThreadCache::current(); MP_LIKELY(tc != nullptr)) {
+        tc->dealloc(size_class, ptr);
+        return;
+    }
+    if(struct rseq* rs = CpuCache::current(); rs != nullptr) {
+        SingleCpuCache::get_instance().dealloc(rs, size_class, ptr);
+        return;
+    }
+    mp_dealloc_small_slow(size_class, ptr);
+}
+
+void* mp_malloc(size_t n) {
+    // malloc(0) 也要返回一个可以 free 的有效地址，size map 把 0 映射到最小的 size class
+    if(MP_UNLIKELY(n > SizeMap::max_size())) {
+        return mp_alloc_large(n, Page::SIZE);
+    }
+    return mp_alloc_small(SizeMap::get_size_class(n));
+}
+
+void mp_free(void* ptr) {
+    if(ptr == nullptr) return;
+
+    // 根据地址反查所在 span，span 上记录了 object 的 size class
+    Span* span = SinglePageMap::get_instance().find_span(ptr);
+    assert(span != nullptr && span->status() == Span::STATUS::USING && "free a pointer not from memory pool");
+    if(span == nullptr) {
+        SPDLOG_ERROR("free a pointer not from memory pool {}", ptr);
+        return;
+    }
+
+    size_t size_class = span->size_class();
+    if(size_class == 0) {
+        SingleLargeCache::get_instance().dealloc(span);
+    } else {
+        mp_dealloc_small(size_class, ptr);
+    }
+}
+
+void mp_free_sized(void* ptr, size_t n) {
+    if(ptr == nullptr) return;
+    // large object 需要通过 span 归还给 page heap
+    if(MP_UNLIKELY(n > SizeMap::max_size())) {
+        mp_free(ptr);
+        return;
+    }
+    mp_dealloc_small(SizeMap::get_size_class(n), ptr);
+}
+
+void* mp_calloc(size_t num, size_t size) {
+    if(size != 0 && num > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    size_t n = num * size;
+    void* ptr = mp_malloc(n);
+    if(ptr != nullptr) {
+        // object 和 span 都会被复用，不能假定内存已清零
+        memset(ptr, 0, n);
+    }
+    return ptr;
+}
+
+void* mp_realloc(void* ptr, size_t n) {
+    if(ptr == nullptr) return mp_malloc(n);
+    if(n == 0) {
+        mp_free(ptr);
+        return nullptr;
+    }
+
+    // 原空间足够，且不会浪费过半空间时，原地返回
+    size_t old = mp_malloc_usable_size(ptr);
+    if(n <= old && n >= old / 2) {
+        return ptr;
+    }
+
+    void* res = mp_malloc(n);
+    if(res == nullptr) return nullptr;
+    memcpy(res, ptr, std::min(old, n));
+    mp_free(ptr);
+    return res;
+}
+
+void* mp_aligned_alloc(size_t align, size_t n) {
+    // 对齐要求必须是 2 的幂
+    if(align == 0 || (align & (align - 1)) != 0) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    if(align <= sizeof(void*)) {
+        return mp_malloc(n);
+    }
+
+    if(n == 0) n = 1;
+    /* span 起始地址按页对齐，object 大小是 align 整数倍的 size class 中每个 object 都是对齐的，
+     * 所以只需找到第一个满足条件的 size class 即可
+     */
+    if(align <= Page::SIZE && n <= SizeMap::max_size()) {
+        n = (n + align - 1) & ~(align - 1);
+        size_t size_class = SizeMap::get_size_class(n);
+        while(size_class < SizeMap::size_class_size && SizeMap::size(size_class) % align != 0) {
+            ++size_class;
+        }
+        if(size_class < SizeMap::size_class_size) {
+            return mp_alloc_small(size_class);
+        }
+    }
+
+    return mp_alloc_large(n, std::max(align, Page::SIZE));
+}
+
+size_t mp_malloc_usable_size(void* ptr) {
+    if(ptr == nullptr) return 0;
+
+    Span* span = SinglePageMap::get_instance().find_span(ptr);
+    if(span == nullptr) return 0;
+
+    size_t size_class = span->size_class();
+    if(size_class != 0) {
+        return SizeMap::size(size_class);
+    }
+    // large object 可能因为对齐不在 span 起始位置
+    return static_cast<char*>(span->end_addr()) - static_cast<char*>(ptr);
+}
+
+size_t mp_alloc_batch(size_t size, void** batch, size_t n) {
+    size_t total = 0;
+    if(size > SizeMap::max_size()) {
+        for(; total < n; ++total) {
+            batch[total] = mp_alloc_large(size, Page::SIZE);
+            if(batch[total] == nullptr) break;
+        }
+        return total;
+    }
+
+    size_t size_class = SizeMap::get_size_class(size);
+    auto& cpu = SingleCpuCache::get_instance();
+    if(ThreadCache* tc = ThreadCache::current(); tc != nullptr) {
+        total = tc->alloc_batch(size_class, batch, n);
+    } else if(!cpu.active() && (tc = ThreadCache::get()) != nullptr) {
+        total = tc->alloc_batch(size_class, batch, n);
+    } else if(cpu.active() && n < SizeMap::num_to_move(size_class)) {
+        for(; total < n; ++total) {
+            batch[total] = cpu.alloc(size_class);
+            if(batch[total] == nullptr) break;
+        }
+    } else {
+        // per-cpu cache 一次放不下这么多，或者线程已经析构了 thread cache
+        total = SingleCentralCahce::get_instance().alloc(size_class, batch, n);
+    }
+
+    if(total != n) {
+        errno = ENOMEM;
+    }
+    return total;
+}
+
+void mp_free_batch(size_t size, void** batch, size_t n) {
+    if(size > SizeMap::max_size()) {
+        for(size_t i = 0; i < n; ++i) {
+            mp_free(batch[i]);
+        }
+        return;
+    }
+
+    size_t size_class = SizeMap::get_size_class(size);
+    auto& cpu = SingleCpuCache::get_instance();
+    if(ThreadCache* tc = ThreadCache::current(); tc != nullptr) {
+        tc->dealloc_batch(size_class, batch, n);
+    } else if(!cpu.active() && (tc = ThreadCache::get()) != nullptr) {
+        tc->dealloc_batch(size_class, batch, n);
+    } else if(cpu.active() && n < SizeMap::num_to_move(size_class)) {
+        for(size_t i = 0; i < n; ++i) {
+            cpu.dealloc(size_class, batch[i]);
+        }
+    } else {
+        auto& cc = SingleCentralCahce::get_instance();
+        for(size_t i = 0; i < n; i += SizeMap::max_move) {
+            cc.dealloc(size_class, batch + i, std::min(n - i, SizeMap::max_move));
+        }
+    }
+}
+
+
+#endif //MEMORYPOOL_MEMORY_POOL_H
@@ -0,0 +1,124 @@
+#ifndef MEMORYPOOL_NEW_DELETE_H
+#define MEMORYPOOL_NEW_DELETE_H
+#include <new>
+#include "libc_override.h"
+
+/* 替换全局 operator new/delete（C++17 全部形式）
+ * 申请统一转发到 malloc/aligned_alloc，与其遵循相同的重入与销毁处理；
+ * sized delete 根据字节数直接得到 size class，跳过 PageMap 查找
+ */
+static void* mp_new(size_t n, size_t align) {
+    while(true) {
+        void* ptr = align > alignof(std::max_align_t) ? aligned_alloc(align, n) : malloc(n);
+        if(ptr != nullptr) return ptr;
+
+        // 按标准语义：失败后调用 new handler 再重试，没有 handler 则抛出异常
+        std::new_handler handler = std::get_new_handler();
+        if(handler == nullptr) throw std::bad_alloc();
+        handler();
+    }
+}
+
+static void* mp_new_nothrow(size_t n, size_t align) noexcept {
+    try {
+        return mp_new(n, align);
+    } catch(...) {
+        return nullptr;
+    }
+}
+
+static void mp_delete_sized(void* ptr, size_t n) noexcept {
+    if(ptr == nullptr) return;
+    auto& ba = SingleBootstrapAlloc::get_instance();
+    if(ba.contains(ptr)) {
+        ba.dealloc(ptr);
+        return;
+    }
+    if(mp_pool_destroyed()) return;
+    ReentryGuard guard;
+    mp_free_sized(ptr, n);
+}
+
+MP_VISIBLE void* operator new(size_t n) {
+    return mp_new(n, 0);
+}
+
+MP_VISIBLE void* operator new[](size_t n) {
+    return mp_new(n, 0);
+}
+
+MP_VISIBLE void* operator new(size_t n, const std::nothrow_t&) noexcept {
+    return mp_new_nothrow(n, 0);
+}
+
+MP_VISIBLE void* operator new[](size_t n, const std::nothrow_t&) noexcept {
+    return mp_new_nothrow(n, 0);
+}
+
+MP_VISIBLE void* operator new(size_t n, std::align_val_t align) {
+    return mp_new(n, static_cast<size_t>(align));
+}
+
+MP_VISIBLE void* operator new[](size_t n, std::align_val_t align) {
+    return mp_new(n, static_cast<size_t>(align));
+}
+
+MP_VISIBLE void* operator new(size_t n, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return mp_new_nothrow(n, static_cast<size_t>(align));
+}
+
+MP_VISIBLE void* operator new[](size_t n, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return mp_new_nothrow(n, static_cast<size_t>(align));
+}
+
+MP_VISIBLE void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+MP_VISIBLE void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+MP_VISIBLE void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    free(ptr);
+}
+
+MP_VISIBLE void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    free(ptr);
+}
+
+MP_VISIBLE void operator delete(void* ptr, size_t n) noexcept {
+    mp_delete_sized(ptr, n);
+}
+
+MP_VISIBLE void operator delete[](void* ptr, size_t n) noexcept {
+    mp_delete_sized(ptr, n);
+}
+
+// 对齐申请使用的 size class 与字节数不一一对应，只能走 PageMap 查找
+MP_VISIBLE void operator delete(void* ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+MP_VISIBLE void operator delete[](void* ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+MP_VISIBLE void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    free(ptr);
+}
+
+MP_VISIBLE void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    free(ptr);
+}
+
+MP_VISIBLE void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+MP_VISIBLE void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+
+#endif //MEMORYPOOL_NEW_DELETE_H
@@ -0,0 +1,130 @@
+#ifndef MEMORYPOOL_BATCH_STACK_H
+#define MEMORYPOOL_BATCH_STACK_H
+#include <atomic>
+#include <cstring>
+#include <cassert>
+#include "size_map.h"
+
+/* transfer cache 的无锁版本，接口与 TransferCache 相同
+ * 每个 size class 的缓存区切成若干个批次槽，每个槽放一整批（num_to_move 个）object 的指针
+ * 装满的槽和空闲的槽各自组成一个 Treiber 栈，栈顶是带版本号的槽下标，版本号避免 ABA
+ * 槽的元数据从不释放，出栈时读取 next 总是安全的
+ */
+class alignas(64) BatchStack {
+public:
+    BatchStack() : _full(pack(_nil, 0)), _empty(pack(_nil, 0)), _used(0),
+                   _batch_size(0), _capacity(0), _slots(nullptr) {}
+
+    // slots 由调用方提供，至少能放下 max_objects 个指针
+    void init(size_t size_class, void** slots);
+
+    // 放入一整批 object，数量不是一整批或者已满时返回 false
+    bool insert_range(void** batch, size_t n);
+    // 取出一整批 object，数量不是一整批或者不足一批时返回 0
+    size_t remove_range(void** batch, size_t n);
+    // 取出一批 object，返回实际个数，用于销毁时清空，n 不能小于一批
+    size_t drain(void** batch, size_t n);
+
+    [[nodiscard]] size_t size() const {
+        return _used.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] size_t capacity() const {
+        return _capacity;
+    }
+public:
+    constexpr static size_t max_objects = 512;
+private:
+    // 栈顶：低 32 位为槽下标，高 32 位为版本号，每次修改加一
+    static uint64_t pack(uint32_t index, uint32_t tag) {
+        return static_cast<uint64_t>(tag) << 32 | index;
+    }
+    static uint32_t index_of(uint64_t head) {
+        return static_cast<uint32_t>(head);
+    }
+    static uint32_t tag_of(uint64_t head) {
+        return static_cast<uint32_t>(head >> 32);
+    }
+
+    void push(std::atomic<uint64_t>& stack, uint32_t index);
+    uint32_t pop(std::atomic<uint64_t>& stack);
+
+private:
+    constexpr static size_t _max_bytes = 256 << 10;
+    constexpr static size_t _max_batches = 64;
+    constexpr static uint32_t _nil = UINT32_MAX;
+    std::atomic<uint64_t> _full;
+    std::atomic<uint64_t> _empty;
+    std::atomic<size_t> _used;
+    size_t _batch_size;
+    size_t _capacity;
+    void** _slots;
+    std::atomic<uint32_t> _next[_max_batches];
+};
+
+void BatchStack::init(size_t size_class, void** slots) {
+    _slots = slots;
+    _batch_size = SizeMap::num_to_move(size_class);
+    size_t batch_bytes = _batch_size * SizeMap::size(size_class);
+    // 至少能放下一批
+    size_t batches = std::max(std::min(max_objects / _batch_size, _max_bytes / batch_bytes), size_t(1));
+    batches = std::min(batches, _max_batches);
+    _capacity = batches * _batch_size;
+    assert(_capacity <= max_objects && "batch stack capacity too large");
+
+    for(size_t i = batches; i-- > 0;) {
+        push(_empty, static_cast<uint32_t>(i));
+    }
+}
+
+void BatchStack::push(std::atomic<uint64_t>& stack, uint32_t index) {
+    uint64_t head = stack.load(std::memory_order_relaxed);
+    do {
+        _next[index].store(index_of(head), std::memory_order_relaxed);
+    } while(!stack.compare_exchange_weak(head, pack(index, tag_of(head) + 1),
+                                         std::memory_order_release, std::memory_order_relaxed));
+}
+
+uint32_t BatchStack::pop(std::atomic<uint64_t>& stack) {
+    uint64_t head = stack.load(std::memory_order_acquire);
+    while(index_of(head) != _nil) {
+        // 读到的 next 可能已过期，此时版本号一定变了，CAS 会失败
+        uint32_t next = _next[index_of(head)].load(std::memory_order_relaxed);
+        if(stack.compare_exchange_weak(head, pack(next, tag_of(head) + 1),
+                                       std::memory_order_acquire, std::memory_order_acquire)) {
+            return index_of(head);
+        }
+    }
+    return _nil;
+}
+
+bool BatchStack::insert_range(void** batch, size_t n) {
+    if(n != _batch_size) return false;
+
+    uint32_t index = pop(_empty);
+    if(index == _nil) return false;
+    memcpy(_slots + index * n, batch, n * sizeof(void*));
+    _used.fetch_add(n, std::memory_order_relaxed);
+    push(_full, index);
+    return true;
+}
+
+size_t BatchStack::remove_range(void** batch, size_t n) {
+    if(n != _batch_size) return 0;
+
+    uint32_t index = pop(_full);
+    if(index == _nil) return 0;
+    _used.fetch_sub(n, std::memory_order_relaxed);
+    memcpy(batch, _slots + index * n, n * sizeof(void*));
+    push(_empty, index);
+    return n;
+}
+
+size_t BatchStack::drain(void** batch, size_t n) {
+    assert(n >= _batch_size && "drain buffer smaller than a batch");
+    if(n < _batch_size) return 0;
+    return remove_range(batch, _batch_size);
+}
+
+
+#endif //MEMORYPOOL_BATCH_STACK_H
@@ -1,6 +1,11 @@
 #ifndef MEMORYPOOL_CENTRAL_CACHE_H
 #define MEMORYPOOL_CENTRAL_CACHE_H
 #include <mutex>
+#include <cstring>
+#include <algorithm>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "span.h"
 #include "size_classes.h"
 #include "size_map.h"
@@ -8,7 +13,20 @@
 #include "page_heap.h"
 #include "page_map.h"
 #include "stats.h"
+#include "adaptive_lock.h"
+#include "transfer_cache.h"
+#include "batch_stack.h"
+#include "bucketed_span_list.h"
 
+/* 整批的申请/归还先经过 transfer cache，只有未命中时才操作 span 链表
+ * span 链表按已分配比例分桶，优先从最满的 span 中申请，让较空的 span 尽快回到 page heap
+ * 环境变量 MEMORYPOOL_CENTRAL_SHARDS=N 开启分片：每个 size class 分成 N 个 shard，
+ * 各自拥有 span 链表、锁和 transfer cache，共享同一个 page heap；
+ * 按当前 CPU（取不到时按线程）选择 shard，自己的 shard 没有 object 时先向相邻的 shard 借
+ * 环境变量 MEMORYPOOL_SPAN_BITMAP=1 时 span 以位图记录空闲 object，申请释放不访问 object 内存
+ * 环境变量 MEMORYPOOL_LOCKFREE_CENTRAL=1 时用无锁的 batch stack 代替 transfer cache，
+ * 整批申请/归还不加锁，只有从 span 补充或归还给 span 时才持有 span 链表的锁
+ */
 class CentralCache {
 public:
     // thread cache 是批量从 central cache 中申请 object
@@ -16,6 +34,17 @@ public:
     // thread cache 也是批量向 central cache 归还 object 的
     void dealloc(size_t size_class, void** batch, size_t n);
 
+    [[nodiscard]] size_t num_shards() const {
+        return _num_shards;
+    }
+
+    // 所有 shard 的 span 链表锁与 transfer cache 锁的统计之和
+    [[nodiscard]] LockStats lock_stats() const;
+    /* 不经过 transfer cache，直接把 object 归还给所在的 span
+     * object 按 span 分组，每组只查一次 PageMap、加一次锁；span 全部空闲后回到 page heap
+     */
+    void release_to_spans(size_t size_class, void** batch, size_t n);
+
     friend std::default_delete<CentralCache>;
     friend Singleton<CentralCache>;
     CentralCache(const CentralCache&) = delete;
@@ -23,34 +52,133 @@ public:
     CentralCache& operator=(const CentralCache&) = delete;
     CentralCache& operator=(const CentralCache&&) = delete;
 private:
-    CentralCache() = default;
+    CentralCache();
     ~CentralCache();
 
-    inline size_t fetch_from_page_heap(size_t size_class, void** batch, size_t n);
+    constexpr static size_t _n = SizeMap::size_class_size;
+    struct Shard {
+        BucketedSpanList lists[_n];
+        mutable AdaptiveLock locks[_n];
+        TransferCache transfers[_n];
+        BatchStack stacks[_n];
+    };
+    // 两种后端共用同一块槽位，按 TransferCache::max_objects 划分
+    static_assert(BatchStack::max_objects == TransferCache::max_objects,
+                  "transfer cache and batch stack must share the slot layout");
+
+    Shard& shard(size_t i) {
+        return i == 0 ? _shard0 : _shards[i - 1];
+    }
+    const Shard& shard(size_t i) const {
+        return i == 0 ? _shard0 : _shards[i - 1];
+    }
+    // 当前线程应该使用的 shard
+    [[nodiscard]] size_t current_shard() const;
+
+    inline size_t fetch_from_page_heap(size_t shard_index, size_t size_class, void** batch, size_t n);
     inline void return_to_page_heap(size_t size_class, Span* span);
     // 从 span 链表中挨个拉取 object
-    size_t fetch_objects(size_t size_class, void** batch, size_t n);
+    static size_t fetch_objects(BucketedSpanList& list, void** batch, size_t n);
+    // 按模式选择 transfer cache 或 batch stack
+    size_t remove_batch(Shard& sd, size_t size_class, void** batch, size_t n) {
+        return _lock_free ? sd.stacks[size_class].remove_range(batch, n)
+                          : sd.transfers[size_class].remove_range(batch, n);
+    }
+    bool insert_batch(Shard& sd, size_t size_class, void** batch, size_t n) {
+        return _lock_free ? sd.stacks[size_class].insert_range(batch, n)
+                          : sd.transfers[size_class].insert_range(batch, n);
+    }
+    size_t drain_batch(Shard& sd, size_t size_class, void** batch, size_t n) {
+        return _lock_free ? sd.stacks[size_class].drain(batch, n)
+                          : sd.transfers[size_class].drain(batch, n);
+    }
 
 private:
-    constexpr static size_t _n = SizeMap::size_class_size;
-    SpanList _lists[_n];
-    mutable std::mutex _locks[_n];
+    constexpr static size_t _max_shards = 64;
+    // 最多向几个相邻的 shard 借 object
+    constexpr static size_t _max_borrow = 4;
+    size_t _num_shards;
+    bool _bitmap_spans;
+    bool _lock_free;
+    Shard _shard0;
+    void* _slots0[_n * TransferCache::max_objects];
+    // 其余 shard 及其 transfer cache 的存储直接 mmap，不经过 malloc
+    Shard* _shards;
+    size_t _shards_bytes;
     Stats _stats;
 };
 
-size_t CentralCache::fetch_objects(const size_t size_class, void** batch, size_t n) {
-    assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
+CentralCache::CentralCache() : _num_shards(1), _bitmap_spans(false), _lock_free(false), _shards(nullptr), _shards_bytes(0) {
+    static_assert([]() {
+        for(size_t i = 1; i < _n; ++i) {
+            if(SizeMap::pages(i) * Page::SIZE / SizeMap::size(i) > Span::max_bitmap_objects) return false;
+        }
+        return true;
+    }(), "every size class must fit in a bitmap span");
+    const char* bitmap = getenv("MEMORYPOOL_SPAN_BITMAP");
+    _bitmap_spans = bitmap != nullptr && strcmp(bitmap, "1") == 0;
+    const char* lock_free = getenv("MEMORYPOOL_LOCKFREE_CENTRAL");
+    _lock_free = lock_free != nullptr && strcmp(lock_free, "1") == 0;
+
+    const char* env = getenv("MEMORYPOOL_CENTRAL_SHARDS");
+    if(env != nullptr) {
+        _num_shards = std::min(std::max(strtoull(env, nullptr, 10), 1ull), static_cast<unsigned long long>(_max_shards));
+    }
+
+    if(_num_shards > 1) {
+        size_t slots_bytes = _n * TransferCache::max_objects * sizeof(void*);
+        _shards_bytes = (_num_shards - 1) * (sizeof(Shard) + slots_bytes);
+        void* ptr = mmap(nullptr, _shards_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(ptr == MAP_FAILED) {
+            SPDLOG_WARN("mmap central cache shards failed, fall back to one shard");
+            _num_shards = 1;
+            _shards_bytes = 0;
+        } else {
+            _shards = static_cast<Shard*>(ptr);
+            auto slots = reinterpret_cast<void**>(_shards + _num_shards - 1);
+            for(size_t i = 1; i < _num_shards; ++i) {
+                new(&_shards[i - 1]) Shard();
+                for(size_t j = 1; j < _n; ++j) {
+                    // 两者只会用到一个，共用同一块存储
+                    _shards[i - 1].transfers[j].init(j, slots);
+                    _shards[i - 1].stacks[j].init(j, slots);
+                    slots += TransferCache::max_objects;
+                }
+            }
+        }
+    }
+
+    for(size_t i = 1; i < _n; ++i) {
+        _shard0.transfers[i].init(i, _slots0 + i * TransferCache::max_objects);
+        _shard0.stacks[i].init(i, _slots0 + i * TransferCache::max_objects);
+    }
+}
+
+size_t CentralCache::current_shard() const {
+    if(_num_shards == 1) return 0;
+    int cpu = sched_getcpu();
+    if(cpu >= 0) {
+        return static_cast<size_t>(cpu) % _num_shards;
+    }
+    // 取不到 CPU 时按线程分散，线程描述符地址的低位是对齐的，先打散
+    auto tid = static_cast<uint64_t>(pthread_self());
+    return static_cast<size_t>((tid * 0x9e3779b97f4a7c15ull) >> 32) % _num_shards;
+}
 
-    auto& list = _lists[size_class];
+size_t CentralCache::fetch_objects(BucketedSpanList& list, void** batch, size_t n) {
     size_t total = 0;
-    // 遍历所有 span，从其中取出 object
-    // span 中没有元素时，从链表上移除 span，边遍历边删除
-    while(!list.empty() && total != n) {
-        auto span = list.first();
+    // 从最满的 span 开始取出 object
+    // span 中没有元素时，从链表上移除 span，否则按新的比例换桶
+    while(total != n) {
+        Span* span = list.fullest();
+        if(span == nullptr) break;
+        size_t old_allocated = span->allocated();
         size_t cnt = span->alloc(batch + total, n - total);
         if(span->empty()) {
             list.remove(span);
-            spdlog::debug("all objects are allocated {}/{}", span->allocated(), span->total());
+            SPDLOG_DEBUG("all objects are allocated {}/{}", span->allocated(), span->total());
+        } else {
+            list.update(span, old_allocated);
         }
 
         total += cnt;
@@ -58,43 +186,70 @@ size_t CentralCache::fetch_objects(const size_t size_class, void** batch, size_t
     return total;
 }
 
-size_t CentralCache::fetch_from_page_heap(const size_t size_class, void** batch, size_t n) {
+size_t CentralCache::fetch_from_page_heap(const size_t shard_index, const size_t size_class, void** batch, size_t n) {
     assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
 
+    auto& list = shard(shard_index).lists[size_class];
     size_t temp = 0, page_num = SizeMap::pages(size_class);
     // 总个数不够时，从 page heap 中申请足够的 object
     while(temp < n) {
         // 从 page heap 申请一个 n page span，只是一个基础的 span
         Span* span = SinglePageHeap::get_instance().alloc(page_num);
         if(span == nullptr) {
-            spdlog::warn("fetch a nullptr span from page heap {}", size_class);
+            SPDLOG_WARN("fetch a nullptr span from page heap {}", size_class);
             break;
         }
         _stats.fetched_incr(span->num_pages());
 
-        // 初始化 span 中的 free list 相关
-        span->init_free_list(SizeMap::size(size_class));
+        // 初始化 span 中的 free list 相关，记录 size class 供释放时反查
+        if(_bitmap_spans) {
+            span->init_bitmap(SizeMap::size(size_class));
+        } else {
+            span->init_free_list(SizeMap::size(size_class));
+        }
+        span->size_class(size_class);
+        span->shard(shard_index);
 
         // 将 span 插入到链表中
-        _lists[size_class].prepend(span);
+        list.insert(span);
 
         temp += span->total();
     }
 
-    return fetch_objects(size_class, batch, n);
+    return fetch_objects(list, batch, n);
 }
 
 size_t CentralCache::alloc(const size_t size_class, void** batch, size_t n) {
     assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
     if(n == 0) return 0;
 
-    std::lock_guard<std::mutex> lg(_locks[size_class]);
+    size_t home = current_shard();
+    auto& sd = shard(home);
+    // 整批申请优先从 transfer cache 中取
+    if(remove_batch(sd, size_class, batch, n) == n) {
+        _stats.allocated_incr(n);
+        return n;
+    }
+
     // 第一次拉取数据
-    size_t total = fetch_objects(size_class, batch, n);
+    size_t total = 0;
+    {
+        std::lock_guard<AdaptiveLock> lg(sd.locks[size_class]);
+        total = fetch_objects(sd.lists[size_class], batch, n);
+    }
+
+    // 向相邻的 shard 借：只取现成的 object，不会触发 page heap 申请
+    for(size_t i = 1; i < _num_shards && i <= _max_borrow && total != n; ++i) {
+        auto& other = shard((home + i) % _num_shards);
+        std::lock_guard<AdaptiveLock> lg(other.locks[size_class]);
+        total += fetch_objects(other.lists[size_class], batch + total, n - total);
+    }
+
     if(total != n) {
-        total += fetch_from_page_heap(size_class, batch + total, n - total);
+        std::lock_guard<AdaptiveLock> lg(sd.locks[size_class]);
+        total += fetch_from_page_heap(home, size_class, batch + total, n - total);
         if(total != n) {
-            spdlog::warn("fetch object in cc: request {} actual {}", n, total);
+            SPDLOG_WARN("fetch object in cc: request {} actual {}", n, total);
         }
     }
 
@@ -107,14 +262,14 @@ void CentralCache::return_to_page_heap(const size_t size_class, Span* span) {
     assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
     if(span == nullptr) return;
     if(span->allocated() != 0) {
-        spdlog::error("return span {}/{}", span->allocated(), span->total());
+        SPDLOG_ERROR("return span {}/{}", span->allocated(), span->total());
     }
     // assert(span->allocated() == 0 && "try returning a using span");
 
     _stats.returned_incr(span->num_pages());
 
     // 将 span 从链表上移除
-    _lists[size_class].remove(span);
+    shard(span->shard()).lists[size_class].remove(span);
 
     // 归还 span 给 page heap
     SinglePageHeap::get_instance().dealloc(span);
@@ -124,45 +279,121 @@ void CentralCache::dealloc(const size_t size_class, void** batch, size_t n) {
     assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
     if(n == 0) return;
 
+    // 整批归还优先放入 transfer cache，满了再逐个归还给 span
+    if(insert_batch(shard(current_shard()), size_class, batch, n)) {
+        _stats.deallocated_incr(n);
+        return;
+    }
+    release_to_spans(size_class, batch, n);
+}
+
+void CentralCache::release_to_spans(const size_t size_class, void** batch, size_t n) {
     auto& pm = SinglePageMap::get_instance();
 
-    std::lock_guard<std::mutex> lg(_locks[size_class]);
-    for(size_t i = 0; i < n; ++i) {
-        Span* span = pm.find_span(batch[i]);
-        if(span == nullptr) {
-            spdlog::error("can't find span when release {}", batch[i]);
-            continue;
+    /* 按地址排序后，同一个 span 的 object 连在一起，每组只需查找一次 PageMap
+     * 查找在加锁之前完成：object 尚未归还，所在 span 不会被释放
+     */
+    void* objects[SizeMap::max_move];
+    Span* spans[SizeMap::max_move];
+    size_t begins[SizeMap::max_move], ends[SizeMap::max_move];
+    for(size_t base = 0; base < n; base += SizeMap::max_move) {
+        size_t cnt = std::min(n - base, SizeMap::max_move);
+        std::copy(batch + base, batch + base + cnt, objects);
+        std::sort(objects, objects + cnt);
+
+        size_t groups = 0;
+        for(size_t i = 0; i < cnt;) {
+            Span* span = pm.find_span(objects[i]);
+            if(span == nullptr) {
+                SPDLOG_ERROR("can't find span when release {}", objects[i]);
+                ++i;
+                continue;
+            }
+            // span 的元数据在加锁后才修改，提前预取，缩短持锁时间
+            MP_PREFETCH_WRITE(span);
+            spans[groups] = span;
+            begins[groups] = i;
+            void* end = span->end_addr();
+            while(i < cnt && objects[i] < end) ++i;
+            ends[groups++] = i;
         }
-        _stats.deallocated_incr();
-        /* 如果归还 object 前，span 已经分配完所有元素了，则将其重新插入到链表 */
-        if(span->empty()) {
-            // spdlog::debug("span {} received first returned object {}, {}/{}",
-            //              static_cast<void*>(span), batch[i], span->allocated(), span->total());
-            _lists[size_class].prepend(span);
+
+        // object 归还给所在 span 的 shard，切换 shard 时才换锁
+        std::unique_lock<AdaptiveLock> lk;
+        size_t locked = _num_shards;
+        for(size_t g = 0; g < groups; ++g) {
+            Span* span = spans[g];
+            size_t num = ends[g] - begins[g];
+            if(span->shard() != locked) {
+                // 先释放原来的锁再加新锁，同时持有两个 shard 的锁可能死锁
+                if(lk.owns_lock()) lk.unlock();
+                locked = span->shard();
+                lk = std::unique_lock<AdaptiveLock>(shard(locked).locks[size_class]);
+            }
+            _stats.deallocated_incr(num);
+            auto& list = shard(locked).lists[size_class];
+            bool was_empty = span->empty();
+            size_t old_allocated = span->allocated();
+            // 整组 object 一次性归还给 span
+            span->dealloc_batch(objects + begins[g], num);
+            /* 如果归还 object 前，span 已经分配完所有元素了，则将其重新插入到链表，否则按新的比例换桶 */
+            if(was_empty) {
+                list.insert(span);
+            } else {
+                list.update(span, old_allocated);
+            }
+            /* 如果 span 中全部元素已归还，释放 span */
+            if(span->full()) {
+                return_to_page_heap(size_class, span);
+            }
         }
-        // 释放 span 中 object
-        span->dealloc(batch[i]);
-        /* 如果 span 中全部元素已归还，释放 span */
-        if(span->full()) {
-            // spdlog::debug("span {} received last returned object {}, {}/{}",
-            //               static_cast<void*>(span), batch[i], span->allocated(), span->total());
-            return_to_page_heap(size_class, span);
+    }
+}
+
+LockStats CentralCache::lock_stats() const {
+    LockStats res;
+    for(size_t k = 0; k < _num_shards; ++k) {
+        for(size_t i = 1; i < _n; ++i) {
+            res += shard(k).locks[i].stats();
+            res += shard(k).transfers[i].lock_stats();
         }
     }
+    return res;
 }
 
 CentralCache::~CentralCache() {
-    spdlog::info("destroy central cache start: ");
-    for(size_t i = 1; i < SizeMap::size_class_size; ++i) {
-        assert(_lists[i].empty() && "make sure all thread cache released");
+    SPDLOG_INFO("destroy central cache start: ");
+    // transfer cache 中的 object 归还给 span，span 全部空闲后回到 page heap
+    void* batch[SizeMap::max_move];
+    for(size_t k = 0; k < _num_shards; ++k) {
+        for(size_t i = 1; i < SizeMap::size_class_size; ++i) {
+            while(size_t cnt = drain_batch(shard(k), i, batch, SizeMap::max_move)) {
+                release_to_spans(i, batch, cnt);
+            }
+        }
+    }
+    for(size_t k = 0; k < _num_shards; ++k) {
+        for(size_t i = 1; i < SizeMap::size_class_size; ++i) {
+            assert(shard(k).lists[i].empty() && "make sure all thread cache released");
+        }
     }
 
-    spdlog::info("fetched pages: {}, returned pages: {}",
+    SPDLOG_INFO("fetched pages: {}, returned pages: {}",
                  _stats.fetched(), _stats.returned());
-    spdlog::info("allocated objects : {}, deallocated objects: {}",
+    SPDLOG_INFO("allocated objects : {}, deallocated objects: {}",
                  _stats.allocated(), _stats.deallocated());
+    [[maybe_unused]] LockStats ls = lock_stats();
+    SPDLOG_INFO("lock acquisitions: {}, contended: {}, wait ns: {}",
+                 ls.acquisitions, ls.contended, ls.wait_ns);
+
+    if(_shards != nullptr) {
+        for(size_t i = 1; i < _num_shards; ++i) {
+            _shards[i - 1].~Shard();
+        }
+        munmap(_shards, _shards_bytes);
+    }
 
-    spdlog::info("destroy central cache end.");
+    SPDLOG_INFO("destroy central cache end.");
 }
 
 using SingleCentralCahce = Singleton<CentralCache>;
@@ -0,0 +1,336 @@
+#ifndef MEMORYPOOL_CPU_CACHE_H
+#define MEMORYPOOL_CPU_CACHE_H
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sysinfo.h>
+#include <sys/syscall.h>
+#include <linux/rseq.h>
+#include <spdlog/spdlog.h>
+#include "size_classes.h"
+#include "size_map.h"
+#include "singleton.h"
+#include "central_cache.h"
+#include "stats.h"
+#include "attributes.h"
+
+// glibc 2.35 起由 glibc 为每个线程注册 rseq，旧版本没有这两个符号
+extern "C" {
+extern const ptrdiff_t __rseq_offset __attribute__((weak));
+extern const unsigned int __rseq_size __attribute__((weak));
+}
+
+/* per-CPU cache：每个 CPU 一块 slab，每个 size class 在 slab 中占 max_capacity 个槽位，按栈使用
+ * 借助 restartable sequences 在不加锁、不用原子指令的情况下对当前 CPU 的 slab 做 push/pop，
+ * 被抢占或迁移到其它 CPU 时内核会中止并从头重试
+ * 空闲内存随 CPU 数而非线程数增长；通过环境变量 MEMORYPOOL_PER_CPU=1 开启，
+ * 当前架构不支持或 rseq 注册失败时返回 inactive，调用方退回 thread cache
+ */
+class CpuCache {
+public:
+    // 当前线程是否可以使用 per-CPU cache，结果为真时记录在线程的 TLS 中
+    [[nodiscard]] bool active() const;
+    void* alloc(size_t size_class);
+    void dealloc(size_t size_class, void* ptr);
+
+    // 当前线程已确认可以使用 per-CPU cache 时返回其 rseq 区域，否则返回 nullptr，不做任何检查
+    static struct rseq* current() {
+        return _current;
+    }
+
+    // 快路径：rs 必须来自 current()，只做一次 rseq push/pop，未命中时进入慢路径
+    MP_ALWAYS_INLINE void* alloc(struct rseq* rs, size_t size_class) {
+        void* object = pop(rs, size_class);
+        if(MP_UNLIKELY(object == nullptr)) {
+            object = refill(rs, size_class);
+        }
+        return object;
+    }
+
+    MP_ALWAYS_INLINE void dealloc(struct rseq* rs, size_t size_class, void* ptr) {
+        if(MP_UNLIKELY(!push(rs, size_class, ptr))) {
+            overflow(rs, size_class, ptr);
+        }
+    }
+
+    friend Singleton<CpuCache>;
+    CpuCache(const CpuCache&) = delete;
+    CpuCache(const CpuCache&&) = delete;
+    CpuCache& operator=(const CpuCache&) = delete;
+    CpuCache& operator=(const CpuCache&&) = delete;
+private:
+    CpuCache();
+    ~CpuCache();
+
+    // 每个 size class 在 slab 头部的描述，[begin, top) 为缓存的 object，push 不能越过 end
+    struct Header {
+        void** top;
+        void** end;
+        void** begin;
+    };
+
+    static struct rseq* rseq_area();
+    void* pop(struct rseq* rs, size_t size_class) const;
+    bool push(struct rseq* rs, size_t size_class, void* ptr) const;
+
+    // 当前 CPU 上 size class 为空，从 central cache 拉取一批
+    MP_NOINLINE void* refill(struct rseq* rs, size_t size_class);
+    // 当前 CPU 上 size class 已满，归还一批给 central cache
+    MP_NOINLINE void overflow(struct rseq* rs, size_t size_class, void* ptr);
+
+    [[nodiscard]] Header* header(size_t cpu, size_t size_class) const {
+        return reinterpret_cast<Header*>(_slabs + cpu * _slab_bytes) + size_class;
+    }
+
+    static constexpr size_t total_capacity() {
+        size_t total = 0;
+        for(const auto& info : size_classes) {
+            total += info.max_capacity;
+        }
+        return total;
+    }
+
+private:
+    constexpr static size_t _n = SizeMap::size_class_size;
+    constexpr static size_t _slab_bytes = 256 << 10;
+    // 单个 size class 在每个 CPU 上最多缓存的字节数，避免大 object 占用过多内存
+    constexpr static size_t _max_class_bytes = 16 << 10;
+    constexpr static uint32_t _rseq_sig = 0x53053053;
+
+    char* _slabs;
+    size_t _num_cpus;
+    size_t _capacity[_n];
+    Stats _stats;
+
+    // glibc 没有注册 rseq 时由各线程自行注册
+    static thread_local struct rseq _rseq __attribute__((tls_model("initial-exec")));
+    static thread_local int _rseq_state __attribute__((tls_model("initial-exec")));
+    // active() 为真后缓存的 rseq 区域，快路径只需读一次 TLS
+    static thread_local struct rseq* _current __attribute__((tls_model("initial-exec")));
+};
+
+thread_local struct rseq CpuCache::_rseq = {};
+thread_local int CpuCache::_rseq_state = 0;
+thread_local struct rseq* CpuCache::_current = nullptr;
+
+CpuCache::CpuCache() : _slabs(nullptr), _num_cpus(0), _capacity() {
+    static_assert(_n * sizeof(Header) + total_capacity() * sizeof(void*) <= _slab_bytes, "slab is too small");
+#if defined(__x86_64__)
+    const char* env = getenv("MEMORYPOOL_PER_CPU");
+    if(env == nullptr || strcmp(env, "1") != 0) return;
+
+    _num_cpus = get_nprocs_conf();
+    void* ptr = mmap(nullptr, _num_cpus * _slab_bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(ptr == MAP_FAILED) {
+        SPDLOG_WARN("mmap per-cpu slabs failed, fall back to thread cache");
+        return;
+    }
+    _slabs = static_cast<char*>(ptr);
+
+    for(size_t i = 1; i < _n; ++i) {
+        size_t capacity = std::max(_max_class_bytes / SizeMap::size(i), size_t(1));
+        _capacity[i] = std::min(capacity, SizeMap::max_capacity(i));
+    }
+
+    for(size_t cpu = 0; cpu < _num_cpus; ++cpu) {
+        auto slots = reinterpret_cast<void**>(header(cpu, _n));
+        for(size_t i = 0; i < _n; ++i) {
+            Header* h = header(cpu, i);
+            h->begin = h->top = slots;
+            h->end = slots + _capacity[i];
+            slots += SizeMap::max_capacity(i);
+        }
+    }
+    SPDLOG_INFO("per-cpu cache enabled on {} cpus", _num_cpus);
+#endif
+}
+
+struct rseq* CpuCache::rseq_area() {
+    if(&__rseq_size != nullptr && __rseq_size != 0) {
+        auto rs = reinterpret_cast<struct rseq*>(static_cast<char*>(__builtin_thread_pointer()) + __rseq_offset);
+        return static_cast<int>(rs->cpu_id) >= 0 ? rs : nullptr;
+    }
+
+    // 0：未尝试注册，1：注册成功，-1：注册失败
+    if(_rseq_state == 0) {
+        _rseq.cpu_id = RSEQ_CPU_ID_UNINITIALIZED;
+        long res = syscall(__NR_rseq, &_rseq, sizeof(_rseq), 0, _rseq_sig);
+        _rseq_state = res == 0 ? 1 : -1;
+    }
+    return _rseq_state == 1 ? &_rseq : nullptr;
+}
+
+bool CpuCache::active() const {
+    if(_current != nullptr) return true;
+    if(_slabs == nullptr) return false;
+    // 线程的 rseq 区域在其生命周期内不变
+    _current = rseq_area();
+    return _current != nullptr;
+}
+
+#if defined(__x86_64__)
+/* rseq 临界区 [1, 2)，最后一条指令提交；中止时内核跳到 4，重新登记临界区后从头执行
+ * 4 之前必须是注册 rseq 时约定的签名
+ */
+#define MP_RSEQ_CS_BEGIN                                \
+    ".pushsection __rseq_cs, \"aw\"\n\t"                \
+    ".balign 32\n\t"                                    \
+    "3:\n\t"                                            \
+    ".long 0x0, 0x0\n\t"                                \
+    ".quad 1f, 2f - 1f, 4f\n\t"                         \
+    ".popsection\n\t"                                   \
+    "6:\n\t"                                            \
+    "leaq 3b(%%rip), %%rax\n\t"                         \
+    "movq %%rax, %[rseq_cs]\n\t"                        \
+    "1:\n\t"
+
+#define MP_RSEQ_CS_END                                  \
+    "2:\n\t"                                            \
+    ".pushsection __rseq_failure, \"ax\"\n\t"           \
+    ".byte 0x0f, 0xb9, 0x3d\n\t"                        \
+    ".long 0x53053053\n\t"                              \
+    "4:\n\t"                                            \
+    "jmp 6b\n\t"                                        \
+    ".popsection\n\t"
+
+// rax = 当前 CPU 上 size class 的 header，CPU 编号越界时直接退出
+#define MP_RSEQ_LOAD_HEADER                             \
+    "movl %[cpu_id], %%eax\n\t"                         \
+    "cmpq %[num_cpus], %%rax\n\t"                       \
+    "jae 2f\n\t"                                        \
+    "imulq %[slab_bytes], %%rax\n\t"                    \
+    "addq %[slabs], %%rax\n\t"                          \
+    "addq %[offset], %%rax\n\t"
+
+MP_ALWAYS_INLINE void* CpuCache::pop(struct rseq* rs, size_t size_class) const {
+    void* res;
+    asm volatile(
+        MP_RSEQ_CS_BEGIN
+        "xorl %k[res], %k[res]\n\t"
+        MP_RSEQ_LOAD_HEADER
+        "movq (%%rax), %%rcx\n\t"
+        "cmpq 16(%%rax), %%rcx\n\t"
+        "je 2f\n\t"
+        "movq -8(%%rcx), %[res]\n\t"
+        "subq $8, %%rcx\n\t"
+        "movq %%rcx, (%%rax)\n\t"
+        MP_RSEQ_CS_END
+        : [res] "=&r"(res), [rseq_cs] "=m"(rs->rseq_cs)
+        : [cpu_id] "m"(rs->cpu_id_start), [num_cpus] "r"(_num_cpus), [slab_bytes] "r"(_slab_bytes),
+          [slabs] "r"(_slabs), [offset] "r"(size_class * sizeof(Header))
+        : "rax", "rcx", "memory", "cc");
+    return res;
+}
+
+MP_ALWAYS_INLINE bool CpuCache::push(struct rseq* rs, size_t size_class, void* ptr) const {
+    size_t res;
+    asm volatile(
+        MP_RSEQ_CS_BEGIN
+        "xorl %k[res], %k[res]\n\t"
+        MP_RSEQ_LOAD_HEADER
+        "movq (%%rax), %%rcx\n\t"
+        "cmpq 8(%%rax), %%rcx\n\t"
+        "je 2f\n\t"
+        "movq %[ptr], (%%rcx)\n\t"
+        "addq $8, %%rcx\n\t"
+        "movl $1, %k[res]\n\t"
+        "movq %%rcx, (%%rax)\n\t"
+        MP_RSEQ_CS_END
+        : [res] "=&r"(res), [rseq_cs] "=m"(rs->rseq_cs)
+        : [cpu_id] "m"(rs->cpu_id_start), [num_cpus] "r"(_num_cpus), [slab_bytes] "r"(_slab_bytes),
+          [slabs] "r"(_slabs), [offset] "r"(size_class * sizeof(Header)), [ptr] "r"(ptr)
+        : "rax", "rcx", "memory", "cc");
+    return res != 0;
+}
+
+#undef MP_RSEQ_CS_BEGIN
+#undef MP_RSEQ_CS_END
+#undef MP_RSEQ_LOAD_HEADER
+#else
+// 不支持的架构上构造时不会分配 slab，active() 恒为 false，不会走到这里
+void* CpuCache::pop(struct rseq*, size_t) const { return nullptr; }
+bool CpuCache::push(struct rseq*, size_t, void*) const { return false; }
+#endif
+
+void* CpuCache::refill(struct rseq* rs, size_t size_class) {
+    // 多拉取的部分放入当前 CPU 的 slab
+    size_t batch_size = std::min(SizeMap::num_to_move(size_class), _capacity[size_class] + 1);
+    void* batch[SizeMap::max_move];
+    size_t cnt = SingleCentralCahce::get_instance().alloc(size_class, batch, batch_size);
+    if(cnt == 0) {
+        SPDLOG_WARN("fetch from central cache failed!: {} 0/{}", size_class, batch_size);
+        return nullptr;
+    }
+    _stats.fetched_incr(cnt);
+
+    size_t i = 1;
+    while(i < cnt && push(rs, size_class, batch[i])) {
+        ++i;
+    }
+    // 期间可能迁移到了 slab 已满的 CPU 上，放不下的还给 central cache
+    if(i < cnt) {
+        _stats.returned_incr(cnt - i);
+        SingleCentralCahce::get_instance().dealloc(size_class, batch + i, cnt - i);
+    }
+    return batch[0];
+}
+
+void CpuCache::overflow(struct rseq* rs, size_t size_class, void* ptr) {
+    size_t batch_size = std::min(SizeMap::num_to_move(size_class), _capacity[size_class]);
+    void* batch[SizeMap::max_move + 1];
+    size_t cnt = 0;
+    while(cnt < batch_size) {
+        void* object = pop(rs, size_class);
+        if(object == nullptr) break;
+        batch[cnt++] = object;
+    }
+    if(!push(rs, size_class, ptr)) {
+        batch[cnt++] = ptr;
+    }
+
+    _stats.returned_incr(cnt);
+    SingleCentralCahce::get_instance().dealloc(size_class, batch, cnt);
+}
+
+void* CpuCache::alloc(size_t size_class) {
+    assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
+    return alloc(rseq_area(), size_class);
+}
+
+void CpuCache::dealloc(size_t size_class, void* ptr) {
+    assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
+    dealloc(rseq_area(), size_class, ptr);
+}
+
+CpuCache::~CpuCache() {
+    if(_slabs == nullptr) return;
+
+    SPDLOG_INFO("destroy cpu cache start: ");
+    // 此时不再有其它线程访问，直接操作各 CPU 的 slab
+    auto& cc = SingleCentralCahce::get_instance();
+    for(size_t cpu = 0; cpu < _num_cpus; ++cpu) {
+        for(size_t i = 1; i < _n; ++i) {
+            Header* h = header(cpu, i);
+            size_t cnt = h->top - h->begin;
+            if(cnt == 0) continue;
+            _stats.returned_incr(cnt);
+            for(size_t j = 0; j < cnt; j += SizeMap::num_to_move(i)) {
+                cc.dealloc(i, h->begin + j, std::min(SizeMap::num_to_move(i), cnt - j));
+            }
+            h->top = h->begin;
+        }
+    }
+    munmap(_slabs, _num_cpus * _slab_bytes);
+
+    SPDLOG_INFO("fetched objects: {}, returned objects: {}",
+                _stats.fetched(), _stats.returned());
+    SPDLOG_INFO("destroy cpu cache end.");
+}
+
+using SingleCpuCache = Singleton<CpuCache>;
+
+
+#endif //MEMORYPOOL_CPU_CACHE_H
@@ -0,0 +1,84 @@
+#ifndef MEMORYPOOL_HUGE_PAGE_FILLER_H
+#define MEMORYPOOL_HUGE_PAGE_FILLER_H
+#include "page.h"
+#include "bitmap.h"
+#include "intrusive_list.h"
+#include "page_tracker.h"
+
+/* 把不足半个 hugepage 的小 span 紧凑地放进部分使用的 hugepage 中
+ * hugepage 按最长空闲区间分组，申请时选能放下的、最长空闲区间最短的 hugepage，
+ * 新的分配集中到已经较满的 hugepage 上，较空的 hugepage 更容易整体空闲
+ * 不加锁，由 page heap 的锁保护
+ */
+class HugePageFiller {
+public:
+    using Tracker = PageTracker<Page::PER_HUGE>;
+
+    HugePageFiller() : _count(0), _used(0) {}
+
+    // 从已有的 hugepage 中申请 n 页，成功时 offset 为页偏移，没有能放下的 hugepage 时返回 nullptr
+    Tracker* alloc(size_t n, size_t& offset);
+    // 加入一个新的完全空闲的 hugepage
+    void add(Tracker* tracker);
+    // 归还 n 页，hugepage 完全空闲时将其移出并返回 true，由调用方归还整个 hugepage
+    bool dealloc(Tracker* tracker, size_t offset, size_t n);
+
+    [[nodiscard]] size_t hugepages() const {
+        return _count;
+    }
+
+    [[nodiscard]] size_t used_pages() const {
+        return _used;
+    }
+private:
+    void insert(Tracker* tracker) {
+        size_t idx = tracker->longest_free();
+        _lists[idx].prepend(tracker);
+        _nonempty.set(idx);
+    }
+
+    void remove(Tracker* tracker) {
+        size_t idx = tracker->longest_free();
+        _lists[idx].remove(tracker);
+        if(_lists[idx].empty()) _nonempty.clear(idx);
+    }
+
+private:
+    IntrusiveList<Tracker> _lists[Page::PER_HUGE + 1];
+    Bitmap<Page::PER_HUGE + 1> _nonempty;
+    size_t _count;
+    size_t _used;
+};
+
+HugePageFiller::Tracker* HugePageFiller::alloc(size_t n, size_t& offset) {
+    size_t idx = _nonempty.find_next(n);
+    if(idx > Page::PER_HUGE) return nullptr;
+
+    Tracker* tracker = _lists[idx].first();
+    remove(tracker);
+    offset = tracker->alloc(n);
+    assert(offset < Page::PER_HUGE && "tracker in wrong list");
+    insert(tracker);
+    _used += n;
+    return tracker;
+}
+
+void HugePageFiller::add(Tracker* tracker) {
+    insert(tracker);
+    ++_count;
+}
+
+bool HugePageFiller::dealloc(Tracker* tracker, size_t offset, size_t n) {
+    remove(tracker);
+    tracker->dealloc(offset, n);
+    _used -= n;
+    if(tracker->empty()) {
+        --_count;
+        return true;
+    }
+    insert(tracker);
+    return false;
+}
+
+
+#endif //MEMORYPOOL_HUGE_PAGE_FILLER_H
@@ -0,0 +1,78 @@
+#ifndef MEMORYPOOL_HUGE_REGION_H
+#define MEMORYPOOL_HUGE_REGION_H
+#include "page.h"
+#include "intrusive_list.h"
+#include "page_tracker.h"
+
+/* 介于半个 hugepage 与若干 MiB 之间的中等 span 从 region 中分配
+ * region 由连续的多个 hugepage 组成，span 可以跨越 hugepage 边界紧密排列，
+ * 不必把每个 span 向上取整到 hugepage；region 中完全空闲的 hugepage 整体归还给系统
+ * 不加锁，由 page heap 的锁保护
+ */
+class HugeRegionSet {
+public:
+    // 每个 region 32 个 hugepage（64 MiB）
+    constexpr static size_t region_pages = 32 * Page::PER_HUGE;
+    using Tracker = PageTracker<region_pages>;
+
+    HugeRegionSet() : _count(0), _used(0), _released(0) {}
+
+    // 从已有的 region 中申请 n 页，成功时 offset 为页偏移，没有能放下的 region 时返回 nullptr
+    Tracker* alloc(size_t n, size_t& offset);
+    void add(Tracker* tracker);
+    // 归还 n 页，region 完全空闲时将其移出并返回 true，由调用方归还整个 region
+    bool dealloc(Tracker* tracker, size_t offset, size_t n);
+
+    [[nodiscard]] size_t regions() const {
+        return _count;
+    }
+
+    [[nodiscard]] size_t used_pages() const {
+        return _used;
+    }
+
+    // 各 region 中已归还给系统的 hugepage 个数
+    [[nodiscard]] size_t released_hugepages() const {
+        return _released;
+    }
+private:
+    // region 个数很少，按加入顺序依次尝试
+    IntrusiveList<Tracker> _regions;
+    size_t _count;
+    size_t _used;
+    size_t _released;
+};
+
+HugeRegionSet::Tracker* HugeRegionSet::alloc(size_t n, size_t& offset) {
+    for(auto it = _regions.begin(); it != _regions.end(); ++it) {
+        if(it->longest_free() < n) continue;
+        size_t before = it->released_hugepages();
+        offset = it->alloc(n);
+        assert(offset < region_pages && "longest free range is stale");
+        _released -= before - it->released_hugepages();
+        _used += n;
+        return &*it;
+    }
+    return nullptr;
+}
+
+void HugeRegionSet::add(Tracker* tracker) {
+    _regions.append(tracker);
+    ++_count;
+}
+
+bool HugeRegionSet::dealloc(Tracker* tracker, size_t offset, size_t n) {
+    tracker->dealloc(offset, n);
+    _used -= n;
+    if(tracker->empty()) {
+        _regions.remove(tracker);
+        _released -= tracker->released_hugepages();
+        --_count;
+        return true;
+    }
+    _released += tracker->release_free_hugepages(offset, n);
+    return false;
+}
+
+
+#endif //MEMORYPOOL_HUGE_REGION_H
@@ -0,0 +1,213 @@
+#ifndef MEMORYPOOL_LARGE_CACHE_H
+#define MEMORYPOOL_LARGE_CACHE_H
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include "span.h"
+#include "page.h"
+#include "singleton.h"
+#include "page_heap.h"
+#include "adaptive_lock.h"
+
+struct LargeCacheStats {
+    // 申请时命中缓存 / 未命中缓存的次数
+    size_t hits = 0;
+    size_t misses = 0;
+    // 因缓存已满被归还给 page heap 的 span 个数
+    size_t evictions = 0;
+    // 缓存中的字节数
+    size_t cached_bytes = 0;
+    // 正在使用的 large object 申请的字节数
+    size_t in_use_bytes = 0;
+
+    [[nodiscard]] double hit_rate() const {
+        return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(hits + misses);
+    }
+};
+
+/* 超过 SizeMap::max_size() 的 large object 直接以整页 span 的形式从 page heap 申请
+ * 释放的 span 先按页数分桶缓存，同样大小的申请直接复用，不必每次在 page heap 中合并再切分
+ * 桶按页数的 2 的幂划分，每个 2 的幂再均分成 4 个桶，同一桶内的页数相差不超过 25%
+ * 每个桶只缓存最近释放的少数 span，超出时淘汰桶中最久未用的；总量超出上限时优先淘汰大 span
+ */
+class LargeCache {
+public:
+    // 申请至少 num_pages 页的 span，bytes 为用户请求的字节数，记录在 span 上
+    Span* alloc(size_t num_pages, size_t bytes);
+    void dealloc(Span* span);
+    // 缓存的 span 全部归还给 page heap
+    void flush();
+
+    [[nodiscard]] LargeCacheStats stats() const;
+
+    friend std::default_delete<LargeCache>;
+    friend Singleton<LargeCache>;
+    LargeCache(const LargeCache&) = delete;
+    LargeCache(const LargeCache&&) = delete;
+    LargeCache& operator=(const LargeCache&) = delete;
+    LargeCache& operator=(const LargeCache&&) = delete;
+private:
+    LargeCache() : _cached_pages(0) {}
+    ~LargeCache();
+
+    // 页数对应的桶，超出缓存范围时返回 _num_buckets
+    static size_t bucket(size_t num_pages);
+    // 从桶中取出页数不小于 num_pages 的 span，没有时返回 nullptr
+    Span* take(size_t idx, size_t num_pages);
+    // 从最大的非空桶中淘汰最久未用的 span
+    Span* evict();
+
+private:
+    constexpr static size_t _sub_buckets = 4;
+    // 单个 span 超过 8 MiB 不缓存，一次巨大的释放不会把缓存中的其它 span 全部挤出去
+    constexpr static size_t _max_log = 23 - Page::SHIFT;
+    constexpr static size_t _max_pages = size_t(1) << _max_log;
+    constexpr static size_t _num_buckets = (_max_log + 1) * _sub_buckets;
+    constexpr static size_t _max_per_bucket = 4;
+    // 缓存总页数上限 64 MiB
+    constexpr static size_t _max_cached_pages = _max_pages * 8;
+    SpanList _buckets[_num_buckets];
+    size_t _counts[_num_buckets] = {};
+    size_t _cached_pages;
+    LargeCacheStats _stats;
+    mutable AdaptiveLock _lock;
+};
+
+size_t LargeCache::bucket(size_t num_pages) {
+    if(num_pages == 0 || num_pages > _max_pages) return _num_buckets;
+    // 最高位决定 2 的幂，其后两位决定子桶
+    size_t log = 63 - __builtin_clzll(num_pages);
+    size_t sub = log >= 2 ? (num_pages >> (log - 2)) & (_sub_buckets - 1) : (num_pages << (2 - log)) & (_sub_buckets - 1);
+    return log * _sub_buckets + sub;
+}
+
+Span* LargeCache::take(size_t idx, size_t num_pages) {
+    if(idx >= _num_buckets) return nullptr;
+    auto& list = _buckets[idx];
+    for(auto it = list.begin(); it != list.end(); ++it) {
+        if(it->num_pages() >= num_pages) {
+            Span* span = &*it;
+            list.remove(span);
+            --_counts[idx];
+            _cached_pages -= span->num_pages();
+            return span;
+        }
+    }
+    return nullptr;
+}
+
+Span* LargeCache::evict() {
+    // 从总量最大的桶中淘汰，大 span 优先归还
+    for(size_t i = _num_buckets; i-- > 0;) {
+        if(_counts[i] == 0) continue;
+        Span* span = _buckets[i].last();
+        _buckets[i].remove(span);
+        --_counts[i];
+        _cached_pages -= span->num_pages();
+        ++_stats.evictions;
+        return span;
+    }
+    return nullptr;
+}
+
+Span* LargeCache::alloc(size_t num_pages, size_t bytes) {
+    Span* span = nullptr;
+    {
+        std::lock_guard<AdaptiveLock> lg(_lock);
+        // 本桶中可能有更小的 span，下一个桶中的 span 一定足够大
+        size_t idx = bucket(num_pages);
+        span = take(idx, num_pages);
+        if(span == nullptr) {
+            span = take(idx + 1, num_pages);
+        }
+        if(span != nullptr) {
+            ++_stats.hits;
+        } else {
+            ++_stats.misses;
+        }
+        _stats.in_use_bytes += bytes;
+    }
+
+    if(span == nullptr) {
+        span = SinglePageHeap::get_instance().alloc(num_pages);
+        if(span == nullptr) {
+            std::lock_guard<AdaptiveLock> lg(_lock);
+            _stats.in_use_bytes -= bytes;
+            return nullptr;
+        }
+    }
+    span->large_bytes(bytes);
+    return span;
+}
+
+void LargeCache::dealloc(Span* span) {
+    // 被淘汰的 span 先串在本地链表上，数量不受限制
+    SpanList victims;
+    {
+        std::lock_guard<AdaptiveLock> lg(_lock);
+        _stats.in_use_bytes -= span->large_bytes();
+        size_t idx = bucket(span->num_pages());
+        if(idx >= _num_buckets) {
+            victims.append(span);
+        } else {
+            // 最近释放的放在桶头部，淘汰时从尾部取
+            _buckets[idx].prepend(span);
+            ++_counts[idx];
+            _cached_pages += span->num_pages();
+            if(_counts[idx] > _max_per_bucket) {
+                Span* old = _buckets[idx].last();
+                _buckets[idx].remove(old);
+                --_counts[idx];
+                _cached_pages -= old->num_pages();
+                ++_stats.evictions;
+                victims.append(old);
+            }
+            // 一直淘汰到总量回到上限以内
+            while(_cached_pages > _max_cached_pages) {
+                victims.append(evict());
+            }
+        }
+    }
+
+    // 归还给 page heap 时不持有缓存的锁
+    auto& ph = SinglePageHeap::get_instance();
+    while(!victims.empty()) {
+        Span* victim = victims.first();
+        victims.remove(victim);
+        ph.dealloc(victim);
+    }
+}
+
+void LargeCache::flush() {
+    while(true) {
+        Span* span = nullptr;
+        {
+            std::lock_guard<AdaptiveLock> lg(_lock);
+            for(size_t i = 0; i < _num_buckets && span == nullptr; ++i) {
+                span = take(i, 0);
+            }
+        }
+        if(span == nullptr) break;
+        SinglePageHeap::get_instance().dealloc(span);
+    }
+}
+
+LargeCacheStats LargeCache::stats() const {
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    LargeCacheStats res = _stats;
+    res.cached_bytes = _cached_pages << Page::SHIFT;
+    return res;
+}
+
+LargeCache::~LargeCache() {
+    SPDLOG_INFO("destroy large cache start: ");
+    [[maybe_unused]] LargeCacheStats s = stats();
+    SPDLOG_INFO("hits: {}, misses: {}, hit rate: {:.2f}, evictions: {}",
+                 s.hits, s.misses, s.hit_rate(), s.evictions);
+    flush();
+    SPDLOG_INFO("destroy large cache end.");
+}
+
+using SingleLargeCache = Singleton<LargeCache>;
+
+
+#endif //MEMORYPOOL_LARGE_CACHE_H
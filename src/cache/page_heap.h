@@ -3,15 +3,39 @@
 #include <list>
 #include <iostream>
 #include <cassert>
+#include <cstring>
 #include <spdlog/spdlog.h>
 #include "size_classes.h"
 #include "span.h"
 #include "singleton.h"
 #include "size_map.h"
 #include "page_map.h"
+#include "adaptive_lock.h"
 #include "system_alloc.h"
 #include "stats.h"
+#include "metadata_arena.h"
+#include "bitmap.h"
+#include "span_tree.h"
+#include "huge_page_filler.h"
+#include "huge_region.h"
+
+struct HugePageStats {
+    // filler 中部分使用的 hugepage 个数及其中已分配的页数
+    size_t filler_hugepages = 0;
+    size_t filler_used_pages = 0;
+    // region 个数及其中已分配的页数
+    size_t regions = 0;
+    size_t region_used_pages = 0;
+    // region 中已归还给系统的 hugepage 个数
+    size_t released_hugepages = 0;
+};
 
+/* 设置 MEMORYPOOL_HUGEPAGE=1 后按 hugepage 组织内存：
+ * 不超过半个 hugepage 的 span 由 filler 紧凑地放进部分使用的 hugepage，
+ * 不超过 8 MiB 的 span 由 region 跨 hugepage 分配，
+ * 更大的 span 向上取整到整数个 hugepage；
+ * 原有的空闲链表只管理整数个 hugepage，所有 span 都不会让一个 hugepage 被两种用途拆散
+ */
 class PageHeap {
 public:
     // central cache 获取一个 span
@@ -19,6 +43,22 @@ public:
     // central cache 归还一个 span
     void dealloc(Span* span);
 
+    [[nodiscard]] LockStats lock_stats() const {
+        return _lock.stats();
+    }
+
+    // 正在使用的 span 元数据字节数
+    [[nodiscard]] size_t metadata_bytes() const {
+        std::lock_guard<AdaptiveLock> lg(_lock);
+        return _spans.in_use_bytes() + _fillers.in_use_bytes() + _regions.in_use_bytes();
+    }
+
+    [[nodiscard]] bool hugepage_aware() const {
+        return _hugepage;
+    }
+
+    [[nodiscard]] HugePageStats hugepage_stats() const;
+
     friend std::default_delete<PageHeap>;
     friend Singleton<PageHeap>;
     PageHeap(const PageHeap&) = delete;
@@ -26,7 +66,7 @@ public:
     PageHeap& operator=(const PageHeap&) = delete;
     PageHeap& operator=(const PageHeap&&) = delete;
 private:
-    PageHeap() = default;
+    PageHeap();
     ~PageHeap();
 
 private:
@@ -44,36 +84,77 @@ private:
     Span* fetch_from_system(size_t n);
     void return_to_system(Span* span);
 
+    // 按页数申请与归还，不经过 hugepage 分组，调用方持有锁
+    Span* alloc_pages(size_t n);
+    void dealloc_pages(Span* span);
+    // hugepage 模式下的申请与归还，调用方持有锁
+    Span* alloc_huge(size_t n);
+    void dealloc_huge(Span* span);
+    // 从 filler / region 中切出 n 页的 span
+    Span* alloc_from_filler(size_t n);
+    Span* alloc_from_region(size_t n);
+
     static size_t span_idx(Span* span);
 
 private:
     constexpr static size_t _n = 1 << (20 - Page::SHIFT);
-    // 前 n 个为 small span，最后一个为 large span
-    SpanList _lists[_n + 1];
-    mutable std::mutex _lock;
+    // 不超过半个 hugepage 的 span 由 filler 分配
+    constexpr static size_t _max_filler_pages = Page::PER_HUGE / 2;
+    // 不超过 8 MiB 的 span 由 region 分配
+    constexpr static size_t _max_region_pages = 4 * Page::PER_HUGE;
+    // k page 的 small span 位于 _lists[k - 1]
+    SpanList _lists[_n];
+    // 超过 _n page 的 large span，按 (页数, 地址) 排序以便 best fit
+    SpanTree _large;
+    // small span 链表是否非空，查找时不必逐个检查链表
+    Bitmap<_n> _nonempty;
+    mutable AdaptiveLock _lock;
+    // span 元数据从这里分配，不经过 new/delete
+    MetadataArena<Span> _spans;
     Stats _stats;
+
+    bool _hugepage;
+    HugePageFiller _filler;
+    HugeRegionSet _region;
+    MetadataArena<HugePageFiller::Tracker> _fillers;
+    MetadataArena<HugeRegionSet::Tracker> _regions;
 };
 
+PageHeap::PageHeap() : _hugepage(false) {
+    const char* env = getenv("MEMORYPOOL_HUGEPAGE");
+    _hugepage = env != nullptr && strcmp(env, "1") == 0;
+}
+
 size_t PageHeap::span_idx(Span* span) {
     return std::min(span->num_pages(), _n + 1) - 1;
 }
 
 void PageHeap::add_to_list(Span* span) {
-    auto& list = _lists[span_idx(span)];
-    list.prepend(span);
+    size_t idx = span_idx(span);
+    if(idx == _n) {
+        _large.insert(span);
+        return;
+    }
+    _lists[idx].prepend(span);
+    _nonempty.set(idx);
 }
 
 void PageHeap::remove_from_list(Span* span) {
     // 从链表上移除当前 span
-    auto& list = _lists[span_idx(span)];
+    size_t idx = span_idx(span);
+    if(idx == _n) {
+        _large.remove(span);
+        return;
+    }
+    auto& list = _lists[idx];
     list.remove(span);
+    if(list.empty()) _nonempty.clear(idx);
 }
 
 Span* PageHeap::create_span(void* ptr, size_t num_page, Span::STATUS status) {
     // 构造一个 span 对象
-    Span* span = new Span(ptr, num_page);
-    // 在 page map 上登记
-    SinglePageMap::get_instance().insert(span);
+    Span* span = _spans.create(ptr, num_page);
+    if(span == nullptr) return nullptr;
 
     // 要么以 idle 状态添加到对应链表，要么以不加入到链表，但必须标记为 using 状态
     if(status == Span::STATUS::IDLE) {
@@ -81,6 +162,8 @@ Span* PageHeap::create_span(void* ptr, size_t num_page, Span::STATUS status) {
     } else {
         span->status(Span::STATUS::USING);
     }
+    // 在 page map 上登记，登记的页数取决于状态，必须在设置状态之后
+    SinglePageMap::get_instance().insert(span);
 
     // 默认是 idle 状态
     return span;
@@ -92,7 +175,7 @@ void PageHeap::destroy_span(Span* span) {
     // 从所在链表上移除
     remove_from_list(span);
     // 释放自身空间
-    delete span;
+    _spans.destroy(span);
 }
 
 Span* PageHeap::carve(Span* span, size_t n) {
@@ -100,40 +183,58 @@ Span* PageHeap::carve(Span* span, size_t n) {
     assert(span->num_pages() >= n && "carved span is smaller than n");
 
     remove_from_list(span);
-    // 恰好为 n page span，不涉及登记相关
+    // 恰好为 n page span，由空闲转为使用中，要补齐每一页的登记
     if(span->num_pages() == n) {
         span->status(Span::STATUS::USING);
+        SinglePageMap::get_instance().insert(span);
         return span;
     }
 
-    // 旧 span 更新其页数为剩余 page 数目，添加到新的 list
-    // 不用重新登记，不用设置起始 page id，状态还是处于 idle 状态
+    // 后 n 个 page 归属于新 span，不需要添加到链表，但是要登记
+    // 先构造新 span，元数据申请失败时旧 span 保持原样
     size_t num_page = span->num_pages() - n;
+    Span* res = create_span(span->page_addr(num_page), n, Span::STATUS::USING);
+    if(res == nullptr) {
+        add_to_list(span);
+        return nullptr;
+    }
+
+    // 旧 span 更新其页数为剩余 page 数目，添加到新的 list
+    // 不用设置起始 page id，状态还是处于 idle 状态
     span->num_pages(num_page);
     add_to_list(span);
-    // spdlog::debug("rem span: {} {}", span->start_addr(), span->end_addr());
+    // 空闲 span 登记的是首尾两页，尾页变了要重新登记
+    SinglePageMap::get_instance().insert(span);
+    // SPDLOG_DEBUG("rem span: {} {}", span->start_addr(), span->end_addr());
 
-    // 后 n 个 page 归属于新 span，不需要添加到链表，但是要登记
-    return create_span(span->page_addr(num_page), n, Span::STATUS::USING);
+    return res;
 }
 
 Span* PageHeap::fetch_from_system(size_t n) {
     // 从 system 中申请一块空间，返回空间可能远大于请求字节数，请求失败则直接返回
     auto& sa = SingleSystemAlloc::get_instance();
     auto [ptr, actual] = sa.alloc(n * Page::SIZE, Page::SIZE);
-    // spdlog::debug("fetch from system: {} {}", ptr, actual);
+    // SPDLOG_DEBUG("fetch from system: {} {}", ptr, actual);
 
     if(!ptr) {
-        spdlog::warn("fetch from system failed: {} pages", n);
+        SPDLOG_WARN("fetch from system failed: {} pages", n);
         return nullptr;
     }
 
     assert(actual % Page::SIZE == 0 && "system alloc not align with page size!");
-
-    _stats.fetched_incr(actual);
+    // system alloc 按 2 MiB 对齐，提示内核用透明大页映射，失败时仍可按普通页使用
+    if(_hugepage) {
+        madvise(ptr, actual, MADV_HUGEPAGE);
+    }
 
     // 构造一个 span 接收申请到的空间，并将其加入到对应 span list 中
-    return create_span(ptr, actual / Page::SIZE);
+    Span* span = create_span(ptr, actual / Page::SIZE);
+    if(span == nullptr) {
+        sa.dealloc(ptr, actual);
+        return nullptr;
+    }
+    _stats.fetched_incr(actual);
+    return span;
 }
 
 void PageHeap::return_to_system(Span* span) {
@@ -153,20 +254,38 @@ void PageHeap::return_to_system(Span* span) {
 }
 
 Span* PageHeap::find_from_large(size_t n) {
-    auto& list = _lists[_n];
-    if(list.empty()) return nullptr;
-    return list.first();
+    // 足够大的 large span 中最小的，相同大小时取地址最低的
+    return _large.best_fit(n);
 }
 
 Span* PageHeap::alloc(size_t n) {
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    Span* span = _hugepage ? alloc_huge(n) : alloc_pages(n);
+    if(span != nullptr) {
+        _stats.allocated_incr(span->num_pages());
+    }
+    return span;
+}
+
+void PageHeap::dealloc(Span* span) {
+    assert(span->status() == Span::STATUS::USING && "span must be using before dealloc!");
+
+    _stats.deallocated_incr(span->num_pages());
+
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    if(span->tracker() != nullptr) {
+        dealloc_huge(span);
+    } else {
+        dealloc_pages(span);
+    }
+}
+
+Span* PageHeap::alloc_pages(size_t n) {
     Span* span = nullptr;
-    std::lock_guard<std::mutex> lg(_lock);
-    // 从 small span 中找出一个 n page span
-    for(size_t i = n; i < _n; ++i) {
-        if(!_lists[i].empty()) {
-            span = _lists[i].first();
-            break;
-        }
+    // 从 small span 中找出一个 n page span，k page span 位于 _lists[k - 1]
+    size_t idx = _nonempty.find_next(n - 1);
+    if(idx < _n) {
+        span = _lists[idx].first();
     }
 
     // 从 large span 中找出一个 n page span
@@ -183,22 +302,17 @@ Span* PageHeap::alloc(size_t n) {
         return nullptr;
     }
 
-    _stats.allocated_incr(n);
-
     return carve(span, n);
 }
 
-void PageHeap::dealloc(Span* span) {
-    assert(span->status() == Span::STATUS::USING && "span must be using before dealloc!");
-
-    _stats.deallocated_incr(span->num_pages());
-
+void PageHeap::dealloc_pages(Span* span) {
     auto& pm = Singleton<PageMap>::get_instance();
     /* span 不在链表上，状态为 using，先标记为空闲状态，解除登记*/
-    std::lock_guard<std::mutex> lg(_lock);
-    span->status(Span::STATUS::IDLE);
+    // 按 using 状态注销全部页，之后作为空闲 span 只登记首尾两页
     pm.erase(span);
-    // spdlog::debug("release span: {} {}", span->start_addr(), span->end_addr());
+    span->status(Span::STATUS::IDLE);
+    span->size_class(0);
+    // SPDLOG_DEBUG("release span: {} {}", span->start_addr(), span->end_addr());
 
     Span* prev = pm.find_prev(span);
     // 前一个字节是否属于某个 span，属于且 span 处于 idle 状态，则合并
@@ -226,26 +340,141 @@ void PageHeap::dealloc(Span* span) {
     pm.insert(span);
 }
 
+Span* PageHeap::alloc_huge(size_t n) {
+    if(n <= _max_filler_pages) return alloc_from_filler(n);
+    if(n <= _max_region_pages) return alloc_from_region(n);
+    // 大 span 向上取整到整数个 hugepage，尾部不与其他 span 共用 hugepage
+    return alloc_pages((n + Page::PER_HUGE - 1) & ~(Page::PER_HUGE - 1));
+}
+
+Span* PageHeap::alloc_from_filler(size_t n) {
+    size_t offset = 0;
+    HugePageFiller::Tracker* tracker = _filler.alloc(n, offset);
+    if(tracker == nullptr) {
+        // 没有能放下的 hugepage，从后端取一个完整的 hugepage
+        Span* backing = alloc_pages(Page::PER_HUGE);
+        if(backing == nullptr) return nullptr;
+        tracker = _fillers.create(backing);
+        if(tracker == nullptr) {
+            dealloc_pages(backing);
+            return nullptr;
+        }
+        _filler.add(tracker);
+        tracker = _filler.alloc(n, offset);
+    }
+
+    Span* span = create_span(tracker->page_addr(offset), n, Span::STATUS::USING);
+    if(span == nullptr) {
+        if(_filler.dealloc(tracker, offset, n)) {
+            dealloc_pages(tracker->backing());
+            _fillers.destroy(tracker);
+        }
+        return nullptr;
+    }
+    span->tracker(tracker);
+    return span;
+}
+
+Span* PageHeap::alloc_from_region(size_t n) {
+    size_t offset = 0;
+    HugeRegionSet::Tracker* tracker = _region.alloc(n, offset);
+    if(tracker == nullptr) {
+        Span* backing = alloc_pages(HugeRegionSet::region_pages);
+        if(backing == nullptr) return nullptr;
+        tracker = _regions.create(backing);
+        if(tracker == nullptr) {
+            dealloc_pages(backing);
+            return nullptr;
+        }
+        _region.add(tracker);
+        tracker = _region.alloc(n, offset);
+    }
+
+    Span* span = create_span(tracker->page_addr(offset), n, Span::STATUS::USING);
+    if(span == nullptr) {
+        if(_region.dealloc(tracker, offset, n)) {
+            dealloc_pages(tracker->backing());
+            _regions.destroy(tracker);
+        }
+        return nullptr;
+    }
+    span->tracker(tracker);
+    return span;
+}
+
+void PageHeap::dealloc_huge(Span* span) {
+    size_t n = span->num_pages();
+    void* tracker = span->tracker();
+    // 由 filler / region 切出的 span 不在链表上，也不参与合并，注销后直接销毁
+    SinglePageMap::get_instance().erase(span);
+
+    if(n <= _max_filler_pages) {
+        auto* t = static_cast<HugePageFiller::Tracker*>(tracker);
+        size_t offset = t->offset_of(span);
+        _spans.destroy(span);
+        // hugepage 完全空闲后整个归还给后端
+        if(_filler.dealloc(t, offset, n)) {
+            dealloc_pages(t->backing());
+            _fillers.destroy(t);
+        }
+        return;
+    }
+
+    auto* t = static_cast<HugeRegionSet::Tracker*>(tracker);
+    size_t offset = t->offset_of(span);
+    _spans.destroy(span);
+    if(_region.dealloc(t, offset, n)) {
+        dealloc_pages(t->backing());
+        _regions.destroy(t);
+    }
+}
+
+HugePageStats PageHeap::hugepage_stats() const {
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    HugePageStats res;
+    res.filler_hugepages = _filler.hugepages();
+    res.filler_used_pages = _filler.used_pages();
+    res.regions = _region.regions();
+    res.region_used_pages = _region.used_pages();
+    res.released_hugepages = _region.released_hugepages();
+    return res;
+}
+
 PageHeap::~PageHeap() {
-    spdlog::info("destroy page heap start: ");
+    SPDLOG_INFO("destroy page heap start: ");
     size_t total = 0;
-    for(size_t i = 1; i <= _n; ++i) {
+    for(size_t i = 0; i < _n; ++i) {
         auto& list = _lists[i];
         if(list.empty()) continue;
         total += list.size();
-        spdlog::debug("{} page span: {}", i, list.size());
+        SPDLOG_DEBUG("{} page span: {}", i + 1, list.size());
         while(!list.empty()) {
-            spdlog::debug("{} page span: {}", i, list.first()->num_pages());
+            SPDLOG_DEBUG("{} page span: {}", i + 1, list.first()->num_pages());
             return_to_system(list.first());
         }
     }
-    spdlog::debug("release {} spans totally.", total);
+    total += _large.size();
+    SPDLOG_DEBUG("large span: {}", _large.size());
+    while(!_large.empty()) {
+        return_to_system(_large.root());
+    }
+    SPDLOG_DEBUG("release {} spans totally.", total);
 
-    spdlog::info("fetched bytes: {}, returned bytes: {}",
+    SPDLOG_INFO("fetched bytes: {}, returned bytes: {}",
                  _stats.fetched(), _stats.returned());
-    spdlog::info("allocated pages: {}, deallocated pages: {}",
+    SPDLOG_INFO("allocated pages: {}, deallocated pages: {}",
                  _stats.allocated(), _stats.deallocated());
-    spdlog::info("destroy page heap end.");
+    SPDLOG_INFO("span metadata in use: {} bytes, reserved: {} bytes",
+                 _spans.in_use_bytes(), _spans.reserved_bytes());
+    if(_hugepage) {
+        SPDLOG_INFO("filler hugepages: {}, used pages: {}; regions: {}, used pages: {}, released hugepages: {}",
+                     _filler.hugepages(), _filler.used_pages(), _region.regions(),
+                     _region.used_pages(), _region.released_hugepages());
+    }
+    [[maybe_unused]] LockStats ls = _lock.stats();
+    SPDLOG_INFO("lock acquisitions: {}, contended: {}, wait ns: {}",
+                 ls.acquisitions, ls.contended, ls.wait_ns);
+    SPDLOG_INFO("destroy page heap end.");
 }
 
 using SinglePageHeap = Singleton<PageHeap>;
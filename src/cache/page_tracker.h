@@ -0,0 +1,141 @@
+#ifndef MEMORYPOOL_PAGE_TRACKER_H
+#define MEMORYPOOL_PAGE_TRACKER_H
+#include <cassert>
+#include "page.h"
+#include "span.h"
+#include "bitmap.h"
+#include "intrusive_list.h"
+#include "system_alloc.h"
+
+/* 记录一段由若干个完整 hugepage 组成的内存（backing span）中每一页是否已分配
+ * 以 first fit 分配连续页，低地址优先，已分配的页尽量集中在少数 hugepage 上
+ * 内部的 hugepage 完全空闲后可以整体归还给系统，不会拆散仍在使用的 hugepage
+ * 不加锁，由 page heap 的锁保护
+ */
+template<size_t Pages>
+class PageTracker : public IntrusiveList<PageTracker<Pages>>::Elem {
+public:
+    static_assert(Pages % Page::PER_HUGE == 0, "tracker must cover whole hugepages");
+    constexpr static size_t num_hugepages = Pages / Page::PER_HUGE;
+
+    explicit PageTracker(Span* backing) : _backing(backing), _used(0), _longest_free(Pages), _released(0) {
+        assert(backing->num_pages() == Pages && "backing span size mismatch");
+    }
+
+    // 分配 n 个连续页，返回起始页的偏移，失败时返回 Pages
+    size_t alloc(size_t n);
+    void dealloc(size_t offset, size_t n);
+    // [offset, offset + n) 所在的 hugepage 中已完全空闲的归还给系统，返回本次归还的个数
+    size_t release_free_hugepages(size_t offset, size_t n);
+
+    [[nodiscard]] Span* backing() const {
+        return _backing;
+    }
+
+    [[nodiscard]] void* page_addr(size_t offset) const {
+        return _backing->page_addr(offset);
+    }
+
+    // span 在 backing span 中的偏移
+    [[nodiscard]] size_t offset_of(const Span* span) const {
+        return span->first_page().id() - _backing->first_page().id();
+    }
+
+    [[nodiscard]] size_t used_pages() const {
+        return _used;
+    }
+
+    [[nodiscard]] size_t longest_free() const {
+        return _longest_free;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return _used == 0;
+    }
+
+    // 已归还给系统、尚未重新使用的 hugepage 个数
+    [[nodiscard]] size_t released_hugepages() const {
+        return _released;
+    }
+private:
+    void update_longest_free();
+    [[nodiscard]] bool hugepage_free(size_t i) const {
+        return _pages.find_next(i * Page::PER_HUGE) >= (i + 1) * Page::PER_HUGE;
+    }
+
+private:
+    Span* _backing;
+    size_t _used;
+    size_t _longest_free;
+    size_t _released;
+    // 置位表示 page 已分配
+    Bitmap<Pages> _pages;
+    // 置位表示 hugepage 已归还给系统
+    Bitmap<num_hugepages> _released_hugepages;
+};
+
+template<size_t Pages>
+size_t PageTracker<Pages>::alloc(size_t n) {
+    if(n == 0 || n > _longest_free) return Pages;
+
+    size_t start = _pages.find_next_clear(0);
+    while(start < Pages) {
+        size_t end = _pages.find_next(start);
+        if(end - start >= n) break;
+        start = _pages.find_next_clear(end);
+    }
+    assert(start < Pages && "longest free range is stale");
+
+    for(size_t i = start; i < start + n; ++i) {
+        _pages.set(i);
+    }
+    // 重新使用已归还的 hugepage，访问时由内核重新分配物理页
+    for(size_t h = start / Page::PER_HUGE; h <= (start + n - 1) / Page::PER_HUGE; ++h) {
+        if(_released_hugepages.test(h)) {
+            _released_hugepages.clear(h);
+            --_released;
+        }
+    }
+    _used += n;
+    update_longest_free();
+    return start;
+}
+
+template<size_t Pages>
+void PageTracker<Pages>::dealloc(size_t offset, size_t n) {
+    assert(offset + n <= Pages && "dealloc out of range");
+    for(size_t i = offset; i < offset + n; ++i) {
+        assert(_pages.test(i) && "double free pages");
+        _pages.clear(i);
+    }
+    _used -= n;
+    update_longest_free();
+}
+
+template<size_t Pages>
+size_t PageTracker<Pages>::release_free_hugepages(size_t offset, size_t n) {
+    size_t res = 0;
+    for(size_t h = offset / Page::PER_HUGE; h <= (offset + n - 1) / Page::PER_HUGE; ++h) {
+        if(_released_hugepages.test(h) || !hugepage_free(h)) continue;
+        SingleSystemAlloc::get_instance().dealloc(page_addr(h * Page::PER_HUGE), Page::HUGE_SIZE);
+        _released_hugepages.set(h);
+        ++_released;
+        ++res;
+    }
+    return res;
+}
+
+template<size_t Pages>
+void PageTracker<Pages>::update_longest_free() {
+    size_t longest = 0;
+    size_t start = _pages.find_next_clear(0);
+    while(start < Pages) {
+        size_t end = _pages.find_next(start);
+        longest = std::max(longest, end - start);
+        start = _pages.find_next_clear(end);
+    }
+    _longest_free = longest;
+}
+
+
+#endif //MEMORYPOOL_PAGE_TRACKER_H
@@ -59,16 +59,16 @@ std::pair<void*, size_t> SystemAlloc::alloc_from_region(size_t n, size_t align)
 }
 
 std::pair<void*, size_t> SystemAlloc::alloc_from_new_region(size_t n, size_t align) {
-    spdlog::info("region memory is not enough, create a new region");
+    SPDLOG_INFO("region memory is not enough, create a new region");
     void* ptr = mmap_align(min_mmap_alloc, min_mmap_alloc);
     if(!ptr) {
-        spdlog::warn("mmap new region memory failed");
+        SPDLOG_WARN("mmap new region memory failed");
         return {nullptr, 0};
     }
     auto start = reinterpret_cast<size_t>(ptr);
     _region = {start, start + min_mmap_alloc};
 
-    spdlog::info("mmap new region succeed");
+    SPDLOG_INFO("mmap new region succeed");
 
     return alloc_from_region(n, align);
 }
@@ -76,8 +76,9 @@ std::pair<void*, size_t> SystemAlloc::alloc_from_new_region(size_t n, size_t ali
 void* SystemAlloc::mmap_align(size_t n, size_t align, bool flag) {
     n += align - 1;
     int prot = flag ? (PROT_READ | PROT_WRITE) : PROT_NONE;
-    char* ptr = static_cast<char*>(mmap(nullptr, n, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
-    // 兼容 ptr == nullptr 情况
+    void* res = mmap(nullptr, n, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(res == MAP_FAILED) return nullptr;
+    char* ptr = static_cast<char*>(res);
     return ptr + (align - reinterpret_cast<size_t>(ptr) % align) % align;
 }
 
@@ -85,11 +86,11 @@ void* SystemAlloc::mmap_align(size_t n, size_t align, bool flag) {
 std::pair<void*, size_t> SystemAlloc::alloc(size_t n, size_t align) {
     // 按照最小系统申请对齐
     align = std::max(align, min_system_alloc);
-    n = round_up(align, min_system_alloc);
+    n = round_up(n, min_system_alloc);
 
     // 超过最大内存/对齐限制
     if(n > max_mmap_alloc || align > max_mmap_alloc) {
-        spdlog::warn("allocate memory is too large");
+        SPDLOG_WARN("allocate memory is too large");
         return {nullptr, 0};
     }
 
@@ -98,11 +99,11 @@ std::pair<void*, size_t> SystemAlloc::alloc(size_t n, size_t align) {
         void* ptr = mmap_align(n, align, true);
         if(ptr != nullptr) {
             _stats.allocated_incr(n);
-            spdlog::info("allocated a super memory by mmap {} {}", n, align);
+            SPDLOG_INFO("allocated a super memory by mmap {} {}", n, align);
             return {ptr, n};
         }
 
-        spdlog::warn("allocated a super memory by mmap failed: {} {}", n, align);
+        SPDLOG_WARN("allocated a super memory by mmap failed: {} {}", n, align);
         return {nullptr, 0};
     }
 
@@ -120,10 +121,10 @@ std::pair<void*, size_t> SystemAlloc::alloc(size_t n, size_t align) {
 bool SystemAlloc::dealloc(void* ptr, size_t n) {
     auto new_start = reinterpret_cast<size_t>(ptr);
     size_t new_end = new_start + n;
-    spdlog::debug("old dealloc region: [{0}, {1})", new_start, new_end);
+    SPDLOG_DEBUG("old dealloc region: [{0}, {1})", new_start, new_end);
     new_start = round_up(new_start, Page::SIZE);
     new_end = round_down(new_end, Page::SIZE);
-    spdlog::debug("new dealloc region: [{0}, {1})", new_start, new_end);
+    SPDLOG_DEBUG("new dealloc region: [{0}, {1})", new_start, new_end);
     if(new_end <= new_start) return false;
 
     _stats.deallocated_incr(new_end - new_start);
@@ -137,13 +138,13 @@ bool SystemAlloc::dealloc(void* ptr, size_t n) {
 }
 
 SystemAlloc::~SystemAlloc() {
-    spdlog::info("destroy system alloc start: ");
+    SPDLOG_INFO("destroy system alloc start: ");
 
-    spdlog::info("fetched pages: {}, returned pages: {}",
+    SPDLOG_INFO("fetched pages: {}, returned pages: {}",
                  _stats.fetched(), _stats.returned());
-    spdlog::info("allocated bytes: {}, deallocated bytes: {}",
+    SPDLOG_INFO("allocated bytes: {}, deallocated bytes: {}",
                  _stats.allocated(), _stats.deallocated());
-    spdlog::info("destroy system alloc end.");
+    SPDLOG_INFO("destroy system alloc end.");
 }
 
 using SingleSystemAlloc = Singleton<SystemAlloc>;
@@ -1,7 +1,7 @@
 #ifndef MEMORYPOOL_THREAD_CACHE_H
 #define MEMORYPOOL_THREAD_CACHE_H
-#include <memory>
 #include <cassert>
+#include <pthread.h>
 #include <spdlog/spdlog.h>
 #include "size_classes.h"
 #include "size_map.h"
@@ -12,34 +12,277 @@
 #include "size_map.h"
 #include "central_cache.h"
 #include "stats.h"
+#include "reentry_guard.h"
+#include "intrusive_list.h"
+#include "attributes.h"
+#include "adaptive_lock.h"
+
+class ThreadCache;
+using ThreadCacheList = IntrusiveList<ThreadCache>;
+
+/* 所有线程的 thread cache 共享一个总的字节预算（默认 32 MiB，可用环境变量 MEMORYPOOL_THREAD_CACHE_BYTES 调整）
+ * 每个 thread cache 持有其中一份额度，各份额度之和不超过总预算：超出额度时先收缩自己的链表，
+ * 之后再从未分配的额度中申请，没有则轮流从其它线程手中偷取
+ * 线程数很多时，新线程只能拿到剩余的额度（可能为 0），靠偷取慢慢获得额度
+ * 线程退出后 thread cache 不会被释放，而是放入 idle 链表，供新线程复用
+ */
+class ThreadCacheBudget {
+public:
+    void add(ThreadCache* tc);
+    // 交还 tc 的额度，并放入 idle 链表
+    void remove(ThreadCache* tc);
+    // 取出一个已退出线程留下的 thread cache，没有则返回 nullptr
+    ThreadCache* recycle();
+    // 为 tc 增加一份额度
+    void grow(ThreadCache* tc);
+
+    [[nodiscard]] size_t overall_bytes() const {
+        std::lock_guard<AdaptiveLock> lg(_lock);
+        return _overall_bytes;
+    }
+    // 调整总预算，并重新平分给现有的 thread cache，每份不超过最小额度，其余留给新线程和按需增长
+    void overall_bytes(size_t n);
 
+    // 线程退出时通过该 key 的析构函数回收 thread cache
+    [[nodiscard]] pthread_key_t key() const {
+        return _key;
+    }
+
+    friend Singleton<ThreadCacheBudget>;
+    ThreadCacheBudget(const ThreadCacheBudget&) = delete;
+    ThreadCacheBudget(const ThreadCacheBudget&&) = delete;
+    ThreadCacheBudget& operator=(const ThreadCacheBudget&) = delete;
+    ThreadCacheBudget& operator=(const ThreadCacheBudget&&) = delete;
+private:
+    ThreadCacheBudget();
+    ~ThreadCacheBudget() = default;
 
-class ThreadCache {
 public:
-    void* alloc(size_t size_class);
-    void dealloc(size_t size_class, void* ptr);
-    ~ThreadCache();
+    // 预算充足时新线程拿到的额度，偷取时不会把对方降到这以下；以及每次增加/偷取的额度
+    constexpr static size_t min_bytes = 512 << 10;
+    constexpr static size_t steal_bytes = 64 << 10;
+private:
+    constexpr static size_t _default_overall_bytes = 32 << 20;
+    // 一次最多尝试从几个线程偷取
+    constexpr static size_t _max_steal_tries = 10;
+    size_t _overall_bytes;
+    ptrdiff_t _unclaimed_bytes;
+    ThreadCacheList _caches;
+    ThreadCacheList _idle;
+    pthread_key_t _key;
+    mutable AdaptiveLock _lock;
+};
+
+using SingleThreadCacheBudget = Singleton<ThreadCacheBudget>;
+
+/* 每个线程一个 thread cache，在线程第一次申请 object 时才创建（或复用已退出线程留下的）
+ * 线程退出时由 pthread key 的析构函数把 object 全部归还给 central cache
+ * alloc/dealloc 快路径只做链表 pop/push 和长度检查，统计、额度检查、scavenge 都放在慢路径
+ */
+class ThreadCache : public ThreadCacheList::Elem {
+public:
+    MP_ALWAYS_INLINE void* alloc(size_t size_class) {
+        assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
+        auto& list = _lists[size_class];
+        if(MP_UNLIKELY(list.empty())) {
+            // 从 central cache 中拉取一批 object，并返回一个 object
+            return fetch_from_central_cache(size_class);
+        }
+        return list.pop();
+    }
+
+    MP_ALWAYS_INLINE void dealloc(size_t size_class, void* ptr) {
+        assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
+        assert(ptr != nullptr && "dealloc nullptr");
+        auto& list = _lists[size_class];
+        list.push(ptr);
+        if(MP_UNLIKELY(list.size() > list.max_length())) {
+            list_too_long(size_class);
+        }
+    }
+
+    /* 批量申请/释放，object 直接在调用方数组和链表之间移动
+     * 数量较多时绕过链表，直接与 central cache 交换，返回实际申请到的个数
+     */
+    size_t alloc_batch(size_t size_class, void** batch, size_t n);
+    void dealloc_batch(size_t size_class, void** batch, size_t n);
 
-    ThreadCache() : _total_bytes(0) {}
     ThreadCache(const ThreadCache&) = delete;
     ThreadCache(const ThreadCache&&) = delete;
     ThreadCache& operator=(const ThreadCache&) = delete;
     ThreadCache& operator=(const ThreadCache&&) = delete;
-    static thread_local std::shared_ptr<ThreadCache> tc;
+    // 当前线程的 thread cache，线程退出析构之后返回 nullptr
+    static ThreadCache* get() {
+        if(MP_LIKELY(_tc != nullptr)) return _tc;
+        return create();
+    }
+
+    // 当前线程已有的 thread cache，不会创建
+    static ThreadCache* current() {
+        return _tc;
+    }
+
+    // 链表上缓存的字节数，遍历所有链表精确计算，用于诊断和测试
+    [[nodiscard]] size_t total_bytes() const;
+
+    [[nodiscard]] size_t max_bytes() const {
+        return _max_bytes.load(std::memory_order_relaxed);
+    }
+
+    // 每个链表归还一半 low water 数量的 object，然后重置 low water
+    void scavenge();
+    /* 请求所有线程做一次 scavenge，只是 best-effort：各线程在下一次进入慢路径时才执行
+     * 快路径不加锁，其它线程无法安全地替它归还，一直不进入慢路径的空闲线程不会响应，
+     * 它缓存的 object 直到线程退出时才归还
+     */
+    static void request_scavenge();
 private:
-    void* fetch_from_central_cache(size_t size_class);
+    ThreadCache();
+    // 只会被复用，不会被释放
+    ~ThreadCache() = default;
+    MP_NOINLINE static ThreadCache* create();
+    // pthread key 析构函数，线程退出时调用
+    static void destroy(void* ptr);
+    // 归还全部 object，恢复到刚创建时的状态
+    void flush();
+
+    MP_NOINLINE void* fetch_from_central_cache(size_t size_class);
     void return_to_central_cache(size_t size_class, size_t n);
-    void list_too_long(size_t size_class);
+    MP_NOINLINE void list_too_long(size_t size_class);
+    // 缓存字节数超过额度，每个链表归还一半 object，直到回到额度以内
+    void shrink();
+    // 慢路径中顺带做的维护：周期性/按请求 scavenge，以及额度检查
+    void maintain();
+    // 刷新 size class 在 _cached_bytes 中的份额，只在慢路径上调用
+    void account(size_t size_class);
 private:
+    friend ThreadCacheBudget;
     constexpr static size_t _max_list_objects = 8192;
     constexpr static size_t _max_overages = 3;
+    // 每进入多少次慢路径做一次 scavenge
+    constexpr static size_t _scavenge_interval = 512;
     DynamicFreeList _lists[SizeMap::size_class_size];
-    size_t _total_bytes;
+    // 其它线程偷取额度时会修改
+    std::atomic<size_t> _max_bytes;
+    /* 额度检查用的缓存字节数，各 size class 的份额在经过它的慢路径上增量刷新，
+     * 快路径不维护，其它 size class 在两次慢路径之间的变化要等到下次刷新（最迟下一次 scavenge）才计入
+     */
+    size_t _cached_bytes;
+    size_t _class_bytes[SizeMap::size_class_size];
+    size_t _scavenge_countdown;
+    // 已处理到第几次 scavenge 请求
+    size_t _scavenge_seen;
     Stats _stats;
+    static std::atomic<size_t> _scavenge_requests;
+    // initial-exec：访问 TLS 只需一条指令，也不会在 malloc 中再次申请内存
+    static thread_local ThreadCache* _tc __attribute__((tls_model("initial-exec")));
+    static thread_local bool _destroyed __attribute__((tls_model("initial-exec")));
 };
 
-// 每个线程都会分配一个不同的 thread cache
-thread_local std::shared_ptr<ThreadCache> ThreadCache::tc = std::make_shared<ThreadCache>();
+thread_local ThreadCache* ThreadCache::_tc = nullptr;
+thread_local bool ThreadCache::_destroyed = false;
+std::atomic<size_t> ThreadCache::_scavenge_requests = 0;
+
+ThreadCacheBudget::ThreadCacheBudget() : _overall_bytes(_default_overall_bytes), _unclaimed_bytes(0), _key() {
+    pthread_key_create(&_key, ThreadCache::destroy);
+    const char* env = getenv("MEMORYPOOL_THREAD_CACHE_BYTES");
+    if(env != nullptr) {
+        _overall_bytes = std::max(strtoull(env, nullptr, 10), static_cast<unsigned long long>(min_bytes));
+    }
+    _unclaimed_bytes = static_cast<ptrdiff_t>(_overall_bytes);
+}
+
+void ThreadCacheBudget::add(ThreadCache* tc) {
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    // 新线程最多拿一份最小额度，不超出剩余的预算
+    auto grant = std::min(std::max(_unclaimed_bytes, ptrdiff_t(0)), static_cast<ptrdiff_t>(min_bytes));
+    tc->_max_bytes.store(static_cast<size_t>(grant), std::memory_order_relaxed);
+    _unclaimed_bytes -= grant;
+    _caches.append(tc);
+}
+
+void ThreadCacheBudget::remove(ThreadCache* tc) {
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    _unclaimed_bytes += static_cast<ptrdiff_t>(tc->_max_bytes.load(std::memory_order_relaxed));
+    tc->_max_bytes.store(0, std::memory_order_relaxed);
+    _caches.remove(tc);
+    _idle.append(tc);
+}
+
+ThreadCache* ThreadCacheBudget::recycle() {
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    if(_idle.empty()) return nullptr;
+    // 后进先出，最近退出的线程留下的 thread cache 更可能还在 CPU cache 中
+    ThreadCache* tc = _idle.last();
+    _idle.remove(tc);
+    return tc;
+}
+
+void ThreadCacheBudget::grow(ThreadCache* tc) {
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    if(_unclaimed_bytes >= static_cast<ptrdiff_t>(steal_bytes)) {
+        _unclaimed_bytes -= static_cast<ptrdiff_t>(steal_bytes);
+        tc->_max_bytes.fetch_add(steal_bytes, std::memory_order_relaxed);
+        return;
+    }
+
+    // 轮流从其它线程偷取：每次检查链表头，检查过的移到链表尾
+    for(size_t i = 0; i < _max_steal_tries && !_caches.empty(); ++i) {
+        ThreadCache* victim = _caches.first();
+        _caches.remove(victim);
+        _caches.append(victim);
+        if(victim == tc || victim->_max_bytes.load(std::memory_order_relaxed) <= min_bytes) {
+            continue;
+        }
+        // 只减少对方的额度，对方下次超出额度时自行收缩
+        victim->_max_bytes.fetch_sub(steal_bytes, std::memory_order_relaxed);
+        tc->_max_bytes.fetch_add(steal_bytes, std::memory_order_relaxed);
+        return;
+    }
+}
+
+void ThreadCacheBudget::overall_bytes(size_t n) {
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    _overall_bytes = std::max(n, min_bytes);
+    size_t cnt = _caches.size();
+    size_t share = cnt == 0 ? 0 : std::min(_overall_bytes / cnt, min_bytes);
+    for(auto it = _caches.begin(); it != _caches.end(); ++it) {
+        it->_max_bytes.store(share, std::memory_order_relaxed);
+    }
+    _unclaimed_bytes = static_cast<ptrdiff_t>(_overall_bytes) - static_cast<ptrdiff_t>(share * cnt);
+}
+
+ThreadCache::ThreadCache() : _max_bytes(0), _cached_bytes(0), _class_bytes(), _scavenge_countdown(_scavenge_interval),
+                             _scavenge_seen(_scavenge_requests.load(std::memory_order_relaxed)) {}
+
+ThreadCache* ThreadCache::create() {
+    // 线程退出阶段其它 TLS 对象仍可能申请、释放内存，此时不再创建
+    if(_destroyed) return nullptr;
+
+    // new ThreadCache、pthread_setspecific 都可能申请内存
+    ReentryGuard guard;
+    auto& budget = SingleThreadCacheBudget::get_instance();
+    ThreadCache* tc = budget.recycle();
+    if(tc == nullptr) {
+        tc = new ThreadCache();
+    }
+    budget.add(tc);
+    // 值非空时线程退出才会调用析构函数
+    pthread_setspecific(budget.key(), tc);
+    _tc = tc;
+    return tc;
+}
+
+void ThreadCache::destroy(void* ptr) {
+    // 归还 object 期间 pool 内部可能再次申请内存
+    ReentryGuard guard;
+    _destroyed = true;
+    _tc = nullptr;
+
+    auto tc = static_cast<ThreadCache*>(ptr);
+    tc->flush();
+    SingleThreadCacheBudget::get_instance().remove(tc);
+}
 
 // 从 central cache 中拉取一批 objects
 void* ThreadCache::fetch_from_central_cache(const size_t size_class) {
@@ -47,6 +290,8 @@ void* ThreadCache::fetch_from_central_cache(const size_t size_class) {
 
     auto& list = _lists[size_class];
     assert(list.empty() && "fetch from cc when list not empty {}");
+    account(size_class);
+    maintain();
 
     // 一批 fetch 多少个 object
     size_t batch_size = SizeMap::num_to_move(size_class);
@@ -56,21 +301,20 @@ void* ThreadCache::fetch_from_central_cache(const size_t size_class) {
     void* batch[SizeMap::max_move];
     size_t cnt = SingleCentralCahce::get_instance().alloc(size_class, batch, batch_size);
     if(cnt == 0) {
-        spdlog::warn("fetch from central cache failed!: {} 0/{}", size_class, batch_size);
+        SPDLOG_WARN("fetch from central cache failed!: {} 0/{}", size_class, batch_size);
+        SPDLOG_WARN("allocated nullptr from tread cache size class {}", size_class);
         return nullptr;
     }
 
     if(cnt != batch_size) {
-        spdlog::warn("fetch from central cache: {} {}/{}", size_class, cnt, batch_size);
+        SPDLOG_WARN("fetch from central cache: {} {}/{}", size_class, cnt, batch_size);
     }
 
     _stats.fetched_incr(cnt);
 
     // 除了第一个 object 外，其它加入到 list 中
-    if(cnt > 0) {
-        _total_bytes += SizeMap::size(size_class) * cnt;
-        list.push_batch(batch + 1, cnt - 1);
-    }
+    list.push_batch(batch + 1, cnt - 1);
+    account(size_class);
 
     // 调整链表最大长度
     if(list.max_length() < batch_size) {
@@ -85,28 +329,6 @@ void* ThreadCache::fetch_from_central_cache(const size_t size_class) {
     return batch[0];
 }
 
-void* ThreadCache::alloc(const size_t size_class) {
-    assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
-
-    void* object = nullptr;
-    // list 中存在 object
-    if(!_lists[size_class].empty()) {
-        object = _lists[size_class].pop();
-    } else {
-        // 从 central cache 中拉取一批 object，并返回一个 object
-        object = fetch_from_central_cache(size_class);
-    }
-
-    if(object) {
-        _total_bytes -= SizeMap::size(size_class);
-        _stats.allocated_incr();
-    } else {
-        spdlog::warn("allocated nullptr from tread cache size class {}", size_class);
-    }
-
-    return object;
-}
-
 void ThreadCache::return_to_central_cache(const size_t size_class, size_t n) {
     assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
     if(n == 0) return;
@@ -116,10 +338,9 @@ void ThreadCache::return_to_central_cache(const size_t size_class, size_t n) {
 
     auto& list = _lists[size_class];
     if(list.size() < n) {
-        spdlog::warn("return request_num({}) > list_num({})", n, list.size());
+        SPDLOG_WARN("return request_num({}) > list_num({})", n, list.size());
         n = list.size();
     }
-    _total_bytes -= n * SizeMap::size(size_class);
     _stats.returned_incr(n);
 
     auto& cc = SingleCentralCahce::get_instance();
@@ -134,12 +355,14 @@ void ThreadCache::return_to_central_cache(const size_t size_class, size_t n) {
         list.pop_batch(batch, n);
         cc.dealloc(size_class, batch, n);
     }
+    account(size_class);
 }
 
 void ThreadCache::list_too_long(const size_t size_class) {
     assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
 
     auto& list = _lists[size_class];
+    SPDLOG_DEBUG("too many idle objects {}: {}/{}", size_class, list.size(), list.max_length());
     // 归还一批 object 对象
     size_t batch_size = SizeMap::num_to_move(size_class);
     return_to_central_cache(size_class, std::min(list.size(), batch_size));
@@ -154,40 +377,154 @@ void ThreadCache::list_too_long(const size_t size_class) {
             list.length_overages(0);
         }
     }
+
+    maintain();
 }
 
-void ThreadCache::dealloc(const size_t size_class, void* ptr) {
+size_t ThreadCache::alloc_batch(const size_t size_class, void** batch, size_t n) {
     assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
 
-    if(ptr == nullptr) return;
+    // 先取链表上已有的 object
+    auto& list = _lists[size_class];
+    size_t total = std::min(list.size(), n);
+    list.pop_batch(batch, total);
+    account(size_class);
+
+    // 剩余数量不少于一批时直接从 central cache 申请，只加一次锁
+    if(n - total >= SizeMap::num_to_move(size_class)) {
+        size_t cnt = SingleCentralCahce::get_instance().alloc(size_class, batch + total, n - total);
+        _stats.fetched_incr(cnt);
+        return total + cnt;
+    }
+
+    for(; total < n; ++total) {
+        batch[total] = alloc(size_class);
+        if(batch[total] == nullptr) break;
+    }
+    return total;
+}
 
-    _total_bytes += SizeMap::size(size_class);
+void ThreadCache::dealloc_batch(const size_t size_class, void** batch, size_t n) {
+    assert(size_class > 0 && size_class < SizeMap::size_class_size && "illegal size_class");
 
+    // 链表还能容纳的部分直接挂到链表上
     auto& list = _lists[size_class];
-    list.push(ptr);
-    _stats.deallocated_incr();
+    size_t room = list.max_length() > list.size() ? list.max_length() - list.size() : 0;
+    size_t cnt = std::min(room, n);
+    list.push_batch(batch, cnt);
+    account(size_class);
+    if(cnt == n) return;
+
+    // 放不下的部分直接归还给 central cache，每次最多 max_move 个，避免长时间持有锁
+    auto& cc = SingleCentralCahce::get_instance();
+    _stats.returned_incr(n - cnt);
+    for(size_t i = cnt; i < n; i += SizeMap::max_move) {
+        cc.dealloc(size_class, batch + i, std::min(n - i, SizeMap::max_move));
+    }
+    maintain();
+}
+
+size_t ThreadCache::total_bytes() const {
+    size_t total = 0;
+    for(size_t i = 1; i < SizeMap::size_class_size; ++i) {
+        total += _lists[i].size() * SizeMap::size(i);
+    }
+    return total;
+}
+
+void ThreadCache::account(size_t size_class) {
+    size_t bytes = _lists[size_class].size() * SizeMap::size(size_class);
+    _cached_bytes = _cached_bytes - _class_bytes[size_class] + bytes;
+    _class_bytes[size_class] = bytes;
+}
+
+void ThreadCache::shrink() {
+    SPDLOG_DEBUG("too many idle bytes: {}/{}", _cached_bytes, _max_bytes.load(std::memory_order_relaxed));
+    // 先刷新全部份额，额度很小（新线程可能为 0）时一轮减半不够，重复直到回到额度以内
+    for(size_t i = 1; i < SizeMap::size_class_size; ++i) {
+        account(i);
+    }
+    bool first = true;
+    while(_cached_bytes > _max_bytes.load(std::memory_order_relaxed)) {
+        for(size_t i = 1; i < SizeMap::size_class_size; ++i) {
+            auto& list = _lists[i];
+            if(list.empty()) continue;
+            // 至少归还一个 object，保证链表最终可以被清空
+            return_to_central_cache(i, (list.size() + 1) / 2);
+            // 链表上限随之收缩，避免马上又涨回来，每次 shrink 只收缩一次
+            if(first) {
+                list.max_length(std::max(list.max_length() / 2, size_t(1)));
+            }
+        }
+        first = false;
+    }
+
+    // 超出额度说明当前线程需要更多额度，收缩之后顺便申请一份
+    SingleThreadCacheBudget::get_instance().grow(this);
+}
 
-    if(list.size() > list.max_length()) {
-        spdlog::debug("too many idle objects {}: {}/{}", size_class, list.size(), list.max_length());
-        list_too_long(size_class);
+void ThreadCache::scavenge() {
+    _scavenge_countdown = _scavenge_interval;
+    _scavenge_seen = _scavenge_requests.load(std::memory_order_relaxed);
+
+    for(size_t i = 1; i < SizeMap::size_class_size; ++i) {
+        auto& list = _lists[i];
+        // scavenge 本来就要遍历所有链表，顺带刷新全部份额
+        account(i);
+        size_t low_water = list.low_water();
+        if(low_water > 0) {
+            // low water 为 1 时也要归还，保证长期不用的 object 最终都能还回去
+            return_to_central_cache(i, (low_water + 1) / 2);
+            // 链表上限同样缩减一批，不低于一批的数量
+            size_t batch_size = SizeMap::num_to_move(i);
+            if(list.max_length() > batch_size) {
+                list.max_length(std::max(list.max_length() - batch_size, batch_size));
+            }
+        }
+        list.clear_low_water();
+    }
+}
+
+void ThreadCache::request_scavenge() {
+    _scavenge_requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ThreadCache::maintain() {
+    // 周期性 scavenge，空闲下来的 object 不会一直被当前线程占着
+    if(--_scavenge_countdown == 0 || _scavenge_seen != _scavenge_requests.load(std::memory_order_relaxed)) {
+        scavenge();
+    }
+    if(_cached_bytes > _max_bytes.load(std::memory_order_relaxed)) {
+        shrink();
     }
 }
 
-ThreadCache::~ThreadCache() {
-    spdlog::info("destroy thread cache start: ");
+void ThreadCache::flush() {
+    SPDLOG_INFO("destroy thread cache start: ");
     size_t total = 0;
     for(size_t i = 1; i < SizeMap::size_class_size; ++i) {
         if(_lists[i].empty()) continue;
-        spdlog::debug("size class {} returned {} objects", i, _lists[i].size());
+        SPDLOG_DEBUG("size class {} returned {} objects", i, _lists[i].size());
         total += _lists[i].size();
         return_to_central_cache(i, _lists[i].size());
     }
-    spdlog::debug("release {} objects totally.", total);
-    spdlog::info("fetched objects: {}, returned objects: {}",
+    SPDLOG_DEBUG("release {} objects totally.", total);
+    SPDLOG_INFO("fetched objects: {}, returned objects: {}",
                  _stats.fetched(), _stats.returned());
-    spdlog::info("allocated objects: {}, deallocated objects: {}",
-                 _stats.allocated(), _stats.deallocated());
-    spdlog::info("destroy thread cache end.");
+
+    // 链表长度上限等状态回到初始值，复用时与新建的 thread cache 一致
+    for(auto& list : _lists) {
+        list = DynamicFreeList();
+    }
+    _cached_bytes = 0;
+    for(auto& bytes : _class_bytes) {
+        bytes = 0;
+    }
+    _scavenge_countdown = _scavenge_interval;
+    _scavenge_seen = _scavenge_requests.load(std::memory_order_relaxed);
+    _stats.fetched(0);
+    _stats.returned(0);
+    SPDLOG_INFO("destroy thread cache end.");
 }
 
 #endif //MEMORYPOOL_THREAD_CACHE_H
@@ -0,0 +1,91 @@
+#ifndef MEMORYPOOL_TRANSFER_CACHE_H
+#define MEMORYPOOL_TRANSFER_CACHE_H
+#include <mutex>
+#include <cstring>
+#include <cassert>
+#include "size_map.h"
+#include "adaptive_lock.h"
+
+/* 每个 size class 一个，缓存若干整批（num_to_move 个）object 的指针
+ * thread cache 与 central cache 交换整批 object 时，只需在这里拷贝一次指针数组，
+ * 不用遍历 span 链表，也不用逐个查找 span，且只持有自己的锁
+ */
+class alignas(64) TransferCache {
+public:
+    TransferCache() : _batch_size(0), _capacity(0), _used(0), _slots(nullptr) {}
+
+    // slots 由调用方提供，至少能放下 max_objects 个指针
+    void init(size_t size_class, void** slots);
+
+    // 放入一整批 object，数量不是一整批或者已满时返回 false
+    bool insert_range(void** batch, size_t n);
+    // 取出一整批 object，数量不是一整批或者不足一批时返回 0
+    size_t remove_range(void** batch, size_t n);
+    // 取出最多 n 个 object，返回实际个数，用于销毁时清空
+    size_t drain(void** batch, size_t n);
+
+    [[nodiscard]] size_t size() const {
+        std::lock_guard<AdaptiveLock> lg(_lock);
+        return _used;
+    }
+
+    [[nodiscard]] size_t capacity() const {
+        return _capacity;
+    }
+
+    [[nodiscard]] LockStats lock_stats() const {
+        return _lock.stats();
+    }
+public:
+    // 每个 size class 最多缓存多少个 object
+    constexpr static size_t max_objects = 512;
+private:
+    // 每个 size class 最多缓存多少字节
+    constexpr static size_t _max_bytes = 256 << 10;
+    size_t _batch_size;
+    size_t _capacity;
+    size_t _used;
+    void** _slots;
+    mutable AdaptiveLock _lock;
+};
+
+void TransferCache::init(size_t size_class, void** slots) {
+    _slots = slots;
+    _batch_size = SizeMap::num_to_move(size_class);
+    size_t batch_bytes = _batch_size * SizeMap::size(size_class);
+    // 至少能放下一批
+    size_t batches = std::max(std::min(max_objects / _batch_size, _max_bytes / batch_bytes), size_t(1));
+    _capacity = batches * _batch_size;
+    assert(_capacity <= max_objects && "transfer cache capacity too large");
+}
+
+bool TransferCache::insert_range(void** batch, size_t n) {
+    if(n != _batch_size) return false;
+
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    if(_used + n > _capacity) return false;
+    memcpy(_slots + _used, batch, n * sizeof(void*));
+    _used += n;
+    return true;
+}
+
+size_t TransferCache::remove_range(void** batch, size_t n) {
+    if(n != _batch_size) return 0;
+
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    if(_used < n) return 0;
+    _used -= n;
+    memcpy(batch, _slots + _used, n * sizeof(void*));
+    return n;
+}
+
+size_t TransferCache::drain(void** batch, size_t n) {
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    n = std::min(n, _used);
+    _used -= n;
+    memcpy(batch, _slots + _used, n * sizeof(void*));
+    return n;
+}
+
+
+#endif //MEMORYPOOL_TRANSFER_CACHE_H
@@ -0,0 +1,133 @@
+#ifndef MEMORYPOOL_ADAPTIVE_LOCK_H
+#define MEMORYPOOL_ADAPTIVE_LOCK_H
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "attributes.h"
+
+// 一把锁的累计统计：加锁次数、需要等待的次数、等待的总时长
+struct LockStats {
+    uint64_t acquisitions = 0;
+    uint64_t contended = 0;
+    uint64_t wait_ns = 0;
+
+    LockStats& operator+=(const LockStats& other) {
+        acquisitions += other.acquisitions;
+        contended += other.contended;
+        wait_ns += other.wait_ns;
+        return *this;
+    }
+};
+
+/* 先自旋一小段时间，仍拿不到锁再用 futex 挂起，临界区很短时大多不必进入内核
+ * 独占一个 cache line，数组中相邻的锁不会互相干扰
+ * 满足 BasicLockable，可直接配合 std::lock_guard / std::unique_lock 使用
+ * 统计数据在持有锁时更新，读取时不加锁，只是近似值
+ */
+class alignas(64) AdaptiveLock {
+public:
+    AdaptiveLock() : _state(UNLOCKED), _acquisitions(0), _contended(0), _wait_ns(0) {}
+
+    AdaptiveLock(const AdaptiveLock&) = delete;
+    AdaptiveLock& operator=(const AdaptiveLock&) = delete;
+
+    MP_ALWAYS_INLINE void lock() {
+        uint32_t expected = UNLOCKED;
+        if(MP_UNLIKELY(!_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire))) {
+            lock_slow();
+        }
+        incr(_acquisitions, 1);
+    }
+
+    bool try_lock() {
+        uint32_t expected = UNLOCKED;
+        if(!_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire)) {
+            return false;
+        }
+        incr(_acquisitions, 1);
+        return true;
+    }
+
+    MP_ALWAYS_INLINE void unlock() {
+        // 有线程挂起时才需要系统调用唤醒
+        if(MP_UNLIKELY(_state.exchange(UNLOCKED, std::memory_order_release) == PARKED)) {
+            futex(FUTEX_WAKE_PRIVATE, 1);
+        }
+    }
+
+    [[nodiscard]] LockStats stats() const {
+        LockStats res;
+        res.acquisitions = _acquisitions.load(std::memory_order_relaxed);
+        res.contended = _contended.load(std::memory_order_relaxed);
+        res.wait_ns = _wait_ns.load(std::memory_order_relaxed);
+        return res;
+    }
+private:
+    // LOCKED：已加锁且没有线程挂起，PARKED：已加锁且可能有线程挂起
+    enum : uint32_t {
+        UNLOCKED = 0,
+        LOCKED = 1,
+        PARKED = 2
+    };
+
+    MP_NOINLINE void lock_slow();
+
+    void futex(int op, uint32_t val) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_state), op, val, nullptr, nullptr, 0);
+    }
+
+    static uint64_t now_ns() {
+        timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    // 只在持有锁时调用，不需要原子的读-改-写
+    static void incr(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+private:
+    constexpr static size_t _spin_count = 128;
+    std::atomic<uint32_t> _state;
+    std::atomic<uint64_t> _acquisitions;
+    std::atomic<uint64_t> _contended;
+    std::atomic<uint64_t> _wait_ns;
+};
+
+void AdaptiveLock::lock_slow() {
+    uint64_t begin = now_ns();
+
+    // 自旋阶段只读不写，锁释放后再尝试抢占
+    for(size_t i = 0; i < _spin_count; ++i) {
+        cpu_relax();
+        uint32_t expected = UNLOCKED;
+        if(_state.load(std::memory_order_relaxed) == UNLOCKED &&
+           _state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire)) {
+            incr(_contended, 1);
+            incr(_wait_ns, now_ns() - begin);
+            return;
+        }
+    }
+
+    // 标记为 PARKED 后挂起，被唤醒时锁仍以 PARKED 状态持有，保证释放时会唤醒其它等待者
+    while(_state.exchange(PARKED, std::memory_order_acquire) != UNLOCKED) {
+        futex(FUTEX_WAIT_PRIVATE, PARKED);
+    }
+    incr(_contended, 1);
+    incr(_wait_ns, now_ns() - begin);
+}
+
+
+#endif //MEMORYPOOL_ADAPTIVE_LOCK_H
@@ -0,0 +1,21 @@
+#ifndef MEMORYPOOL_ATTRIBUTES_H
+#define MEMORYPOOL_ATTRIBUTES_H
+
+// 快路径强制内联，慢路径禁止内联，避免慢路径代码把快路径撑大
+#define MP_ALWAYS_INLINE inline __attribute__((always_inline))
+#define MP_NOINLINE __attribute__((noinline))
+
+#define MP_LIKELY(x) __builtin_expect(!!(x), 1)
+#define MP_UNLIKELY(x) __builtin_expect(!!(x), 0)
+
+// 预取到各级 cache，不会因为非法地址（包括 nullptr）出错；定义 MEMORYPOOL_NO_PREFETCH 时关闭，用于对比
+#ifndef MEMORYPOOL_NO_PREFETCH
+#define MP_PREFETCH(addr) __builtin_prefetch((addr), 0, 3)
+#define MP_PREFETCH_WRITE(addr) __builtin_prefetch((addr), 1, 3)
+#else
+#define MP_PREFETCH(addr) ((void)(addr))
+#define MP_PREFETCH_WRITE(addr) ((void)(addr))
+#endif
+
+
+#endif //MEMORYPOOL_ATTRIBUTES_H
@@ -0,0 +1,54 @@
+#ifndef MEMORYPOOL_BITMAP_H
+#define MEMORYPOOL_BITMAP_H
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+// 定长位图，按 64 位字查找置位，每个字只需一条 count-trailing-zeros 指令
+template<size_t N>
+class Bitmap {
+public:
+    Bitmap() : _bits() {}
+
+    void set(size_t i) {
+        _bits[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    void clear(size_t i) {
+        _bits[i / 64] &= ~(uint64_t(1) << (i % 64));
+    }
+
+    [[nodiscard]] bool test(size_t i) const {
+        return (_bits[i / 64] >> (i % 64)) & 1;
+    }
+
+    // 下标不小于 start 的第一个置位，没有时返回 N
+    [[nodiscard]] size_t find_next(size_t start) const {
+        if(start >= N) return N;
+        size_t w = start / 64;
+        uint64_t bits = _bits[w] & (~uint64_t(0) << (start % 64));
+        while(true) {
+            if(bits != 0) return w * 64 + __builtin_ctzll(bits);
+            if(++w == _words) return N;
+            bits = _bits[w];
+        }
+    }
+
+    // 下标不小于 start 的第一个清零位，没有时返回 N
+    [[nodiscard]] size_t find_next_clear(size_t start) const {
+        if(start >= N) return N;
+        size_t w = start / 64;
+        uint64_t bits = ~_bits[w] & (~uint64_t(0) << (start % 64));
+        while(true) {
+            if(bits != 0) return std::min(w * 64 + __builtin_ctzll(bits), N);
+            if(++w == _words) return N;
+            bits = ~_bits[w];
+        }
+    }
+private:
+    constexpr static size_t _words = (N + 63) / 64;
+    uint64_t _bits[_words];
+};
+
+
+#endif //MEMORYPOOL_BITMAP_H
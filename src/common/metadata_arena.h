@@ -0,0 +1,117 @@
+#ifndef MEMORYPOOL_METADATA_ARENA_H
+#define MEMORYPOOL_METADATA_ARENA_H
+#include <new>
+#include <utility>
+#include "free_list.h"
+#include "system_alloc.h"
+
+/* pool 自身元数据（如 Span）的定长分配器，不经过 malloc/new
+ * 从 SystemAlloc 整块申请内存，按对象大小顺序切分，释放的对象挂到自由链表上复用
+ * 不加锁，由调用方保证互斥（PageHeap 在自己的锁内使用）
+ */
+template<typename T>
+class MetadataArena {
+public:
+    MetadataArena() : _cur(nullptr), _end(nullptr), _chunks(nullptr), _in_use(0), _reserved(0) {}
+    ~MetadataArena();
+
+    MetadataArena(const MetadataArena&) = delete;
+    MetadataArena& operator=(const MetadataArena&) = delete;
+
+    // 申请失败返回 nullptr
+    template<typename... Args>
+    T* create(Args&&... args);
+    void destroy(T* obj);
+
+    // 正在使用的对象占用的字节数
+    [[nodiscard]] size_t in_use_bytes() const {
+        return _in_use * _object_size;
+    }
+
+    // 从系统申请的字节数
+    [[nodiscard]] size_t reserved_bytes() const {
+        return _reserved;
+    }
+private:
+    // 每块内存开头记录块大小，并串成链表，销毁时归还
+    struct Chunk {
+        Chunk* next;
+        size_t bytes;
+    };
+
+    bool refill();
+
+private:
+    constexpr static size_t _align = std::max(alignof(T), alignof(void*));
+    constexpr static size_t _object_size = (std::max(sizeof(T), sizeof(void*)) + _align - 1) & ~(_align - 1);
+    constexpr static size_t _header_size = (sizeof(Chunk) + _align - 1) & ~(_align - 1);
+    constexpr static size_t _chunk_bytes = 64 << 10;
+    FreeList _free;
+    char* _cur;
+    char* _end;
+    Chunk* _chunks;
+    size_t _in_use;
+    size_t _reserved;
+};
+
+template<typename T>
+template<typename... Args>
+T* MetadataArena<T>::create(Args&&... args) {
+    void* ptr = nullptr;
+    if(!_free.empty()) {
+        ptr = _free.pop();
+    } else {
+        if(_end - _cur < static_cast<ptrdiff_t>(_object_size) && !refill()) {
+            return nullptr;
+        }
+        ptr = _cur;
+        _cur += _object_size;
+    }
+    ++_in_use;
+    return new(ptr) T(std::forward<Args>(args)...);
+}
+
+template<typename T>
+void MetadataArena<T>::destroy(T* obj) {
+    if(obj == nullptr) return;
+    obj->~T();
+    _free.push(obj);
+    --_in_use;
+}
+
+template<typename T>
+bool MetadataArena<T>::refill() {
+    // SystemAlloc 按自己的粒度向上取整，实际拿到的可能更多，全部用于切分
+    auto [ptr, actual] = SingleSystemAlloc::get_instance().alloc(_chunk_bytes, Page::SIZE);
+    if(ptr == nullptr) {
+        SPDLOG_WARN("fetch metadata chunk from system failed");
+        return false;
+    }
+    auto chunk = static_cast<Chunk*>(ptr);
+    chunk->next = _chunks;
+    chunk->bytes = actual;
+    _chunks = chunk;
+    _reserved += actual;
+
+    // 当前块剩余的尾部不足一个对象，直接丢弃
+    _cur = static_cast<char*>(ptr) + _header_size;
+    _end = static_cast<char*>(ptr) + actual;
+    return true;
+}
+
+template<typename T>
+MetadataArena<T>::~MetadataArena() {
+    // 仍有对象在使用时可能还会被访问（如通过 page map），不归还内存
+    if(_in_use != 0) {
+        SPDLOG_WARN("{} metadata objects still in use", _in_use);
+        return;
+    }
+    while(_chunks != nullptr) {
+        Chunk* next = _chunks->next;
+        SingleSystemAlloc::get_instance().dealloc(_chunks, _chunks->bytes);
+        _chunks = next;
+    }
+}
+
+
+#endif //MEMORYPOOL_METADATA_ARENA_H
@@ -6,6 +6,10 @@ class Page {
 public:
     constexpr static size_t SHIFT = 13;
     constexpr static size_t SIZE = 1 << 13;
+    // 透明大页（THP）：2 MiB，包含 PER_HUGE 个 page
+    constexpr static size_t HUGE_SHIFT = 21;
+    constexpr static size_t HUGE_SIZE = 1 << HUGE_SHIFT;
+    constexpr static size_t PER_HUGE = 1 << (HUGE_SHIFT - SHIFT);
 private:
     size_t _id;
 public:
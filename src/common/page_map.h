@@ -1,10 +1,19 @@
 #ifndef MEMORYPOOL_PAGE_MAP_H
 #define MEMORYPOOL_PAGE_MAP_H
-#include <map>
+#include <atomic>
 #include <mutex>
+#include <cassert>
+#include <algorithm>
+#include <sys/mman.h>
 #include "span.h"
 #include "singleton.h"
+#include "adaptive_lock.h"
 
+/* 以 page id 为下标的三层 radix tree，查找不加锁，只有登记/注销（会创建中间节点）时加锁
+ * 使用中的 span 登记每一页，任意 object 地址都能直接查到所在 span；
+ * 空闲 span 只用于合并时查找前后相邻的 span，只登记首尾两页，避免大块空闲 span 反复登记每一页
+ * 48 位地址空间，page id 共 48 - Page::SHIFT = 35 位，按 12 / 12 / 11 位分层，节点直接 mmap
+ */
 class PageMap {
 public:
     void insert(Span* s);
@@ -13,6 +22,15 @@ public:
     Span* find_prev(Span* span) const;
     Span* find_next(Span* span) const;
 
+    [[nodiscard]] LockStats lock_stats() const {
+        return _lock.stats();
+    }
+
+    // 中间节点和叶子节点占用的字节数
+    [[nodiscard]] size_t node_bytes() const {
+        return _node_bytes.load(std::memory_order_relaxed);
+    }
+
     friend std::default_delete<PageMap>;
     friend Singleton<PageMap>;
     PageMap(const PageMap&) = delete;
@@ -20,21 +38,114 @@ public:
     PageMap& operator=(const PageMap&) = delete;
     PageMap& operator=(const PageMap&&) = delete;
 private:
-    PageMap() = default;
-    ~PageMap() = default;
+    PageMap() : _root(), _node_bytes(0) {}
+    ~PageMap();
+
+    constexpr static size_t _address_bits = 48;
+    constexpr static size_t _leaf_bits = 11;
+    constexpr static size_t _mid_bits = 12;
+    constexpr static size_t _root_bits = _address_bits - Page::SHIFT - _leaf_bits - _mid_bits;
+    static_assert(_root_bits == 12, "unexpected radix tree layout");
+
+    struct Leaf {
+        std::atomic<Span*> spans[size_t(1) << _leaf_bits];
+    };
+    struct Mid {
+        std::atomic<Leaf*> leaves[size_t(1) << _mid_bits];
+    };
+
+    // 返回 page id 所在的叶子，create 为 true 时按需创建（需持有锁）
+    Leaf* leaf(size_t id, bool create);
+    [[nodiscard]] Leaf* leaf(size_t id) const;
+    // 将 [first, last] 中的每一页设置为 value，expect 非空时只修改当前指向 expect 的页
+    void assign(size_t first, size_t last, Span* value, Span* expect);
+    // 按 span 的状态登记每一页或首尾两页
+    void assign(Span* s, Span* value, Span* expect);
+
+    template<typename T>
+    T* create_node();
+
 private:
-    std::map<void*, Span*> _mp;
-    mutable std::mutex _lock;
+    std::atomic<Mid*> _root[size_t(1) << _root_bits];
+    std::atomic<size_t> _node_bytes;
+    mutable AdaptiveLock _lock;
 };
 
+template<typename T>
+T* PageMap::create_node() {
+    // mmap 的内存已清零，atomic 指针全部为 nullptr
+    void* ptr = mmap(nullptr, sizeof(T), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ptr == MAP_FAILED) return nullptr;
+    _node_bytes.fetch_add(sizeof(T), std::memory_order_relaxed);
+    return static_cast<T*>(ptr);
+}
+
+PageMap::Leaf* PageMap::leaf(size_t id) const {
+    size_t root_idx = id >> (_mid_bits + _leaf_bits);
+    if(root_idx >= (size_t(1) << _root_bits)) return nullptr;
+    Mid* mid = _root[root_idx].load(std::memory_order_acquire);
+    if(mid == nullptr) return nullptr;
+    return mid->leaves[(id >> _leaf_bits) & ((size_t(1) << _mid_bits) - 1)].load(std::memory_order_acquire);
+}
+
+PageMap::Leaf* PageMap::leaf(size_t id, bool create) {
+    Leaf* res = static_cast<const PageMap*>(this)->leaf(id);
+    if(res != nullptr || !create) return res;
+
+    size_t root_idx = id >> (_mid_bits + _leaf_bits);
+    assert(root_idx < (size_t(1) << _root_bits) && "address out of range");
+    Mid* mid = _root[root_idx].load(std::memory_order_relaxed);
+    if(mid == nullptr) {
+        mid = create_node<Mid>();
+        if(mid == nullptr) return nullptr;
+        // release 保证读者看到节点时其内容已初始化
+        _root[root_idx].store(mid, std::memory_order_release);
+    }
+    auto& slot = mid->leaves[(id >> _leaf_bits) & ((size_t(1) << _mid_bits) - 1)];
+    res = create_node<Leaf>();
+    if(res == nullptr) return nullptr;
+    slot.store(res, std::memory_order_release);
+    return res;
+}
+
+void PageMap::assign(size_t first, size_t last, Span* value, Span* expect) {
+    constexpr size_t mask = (size_t(1) << _leaf_bits) - 1;
+    size_t id = first;
+    size_t end = last + 1;
+    while(id < end) {
+        // 一次处理同一个叶子中的连续页
+        size_t stop = std::min(end, (id | mask) + 1);
+        Leaf* node = leaf(id, value != nullptr);
+        if(node == nullptr) {
+            assert(value == nullptr && "create page map node failed");
+            id = stop;
+            continue;
+        }
+        for(; id < stop; ++id) {
+            auto& slot = node->spans[id & mask];
+            if(expect == nullptr || slot.load(std::memory_order_relaxed) == expect) {
+                slot.store(value, std::memory_order_release);
+            }
+        }
+    }
+}
+
+void PageMap::assign(Span* s, Span* value, Span* expect) {
+    size_t first = s->first_page().id();
+    size_t last = first + s->num_pages() - 1;
+    if(s->status() == Span::STATUS::USING) {
+        assign(first, last, value, expect);
+    } else {
+        assign(first, first, value, expect);
+        assign(last, last, value, expect);
+    }
+}
+
 Span* PageMap::find_span(void* ptr) const {
-    std::lock_guard<std::mutex> lg(_lock);
-    auto it = _mp.upper_bound(ptr);
-    if(it == _mp.begin()) { return nullptr; }
-    --it;
-    auto span = it->second;
-    if(ptr >= span->end_addr()) { return nullptr; }
-    return span;
+    size_t id = reinterpret_cast<size_t>(ptr) >> Page::SHIFT;
+    Leaf* node = leaf(id);
+    if(node == nullptr) { return nullptr; }
+    return node->spans[id & ((size_t(1) << _leaf_bits) - 1)].load(std::memory_order_acquire);
 }
 
 Span* PageMap::find_prev(Span* span) const {
@@ -46,13 +157,26 @@ Span* PageMap::find_next(Span* span) const {
 }
 
 void PageMap::insert(Span* s) {
-    std::lock_guard<std::mutex> lg(_lock);
-    _mp[s->start_addr()] = s;
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    assign(s, s, nullptr);
 }
 
 void PageMap::erase(Span* s) {
-    std::lock_guard<std::mutex> lg(_lock);
-    _mp.erase(s->start_addr());
+    // 页可能已经登记给了切分出来的新 span，只清除仍指向 s 的页；按登记时的状态注销
+    std::lock_guard<AdaptiveLock> lg(_lock);
+    assign(s, nullptr, s);
+}
+
+PageMap::~PageMap() {
+    for(auto& root : _root) {
+        Mid* mid = root.load(std::memory_order_relaxed);
+        if(mid == nullptr) continue;
+        for(auto& slot : mid->leaves) {
+            Leaf* node = slot.load(std::memory_order_relaxed);
+            if(node != nullptr) munmap(node, sizeof(Leaf));
+        }
+        munmap(mid, sizeof(Mid));
+    }
 }
 
 using SinglePageMap = Singleton<PageMap>;
@@ -0,0 +1,30 @@
+#ifndef MEMORYPOOL_REENTRY_GUARD_H
+#define MEMORYPOOL_REENTRY_GUARD_H
+#include <utility>
+
+/* 标记当前线程正在执行 memory pool 内部逻辑
+ * 替换掉 libc malloc 之后，pool 内部（thread cache 构造、spdlog 日志等）申请内存会重新进入 malloc，
+ * 这类嵌套请求不能再进入 pool（可能重复加锁），需要交给 BootstrapAlloc 处理
+ */
+class ReentryGuard {
+public:
+    ReentryGuard() { ++_depth; }
+    ~ReentryGuard() { --_depth; }
+
+    ReentryGuard(const ReentryGuard&) = delete;
+    ReentryGuard(const ReentryGuard&&) = delete;
+    ReentryGuard& operator=(const ReentryGuard&) = delete;
+    ReentryGuard& operator=(const ReentryGuard&&) = delete;
+
+    static bool active() {
+        return _depth != 0;
+    }
+private:
+    // initial-exec：访问 TLS 不经过 __tls_get_addr，也就不会在 malloc 中再次申请内存
+    static thread_local size_t _depth __attribute__((tls_model("initial-exec")));
+};
+
+thread_local size_t ReentryGuard::_depth = 0;
+
+
+#endif //MEMORYPOOL_REENTRY_GUARD_H
@@ -1,7 +1,9 @@
 #ifndef MEMORYPOOL_SIZE_MAP_H
 #define MEMORYPOOL_SIZE_MAP_H
-#include <mutex>
+#include <array>
 #include <cassert>
+#include <cstdint>
+#include <type_traits>
 #include "size_classes.h"
 
 class SizeMap {
@@ -13,53 +15,73 @@ private:
     constexpr static size_t _large_size = 1024;
     constexpr static size_t _large_size_alignment = 128;
     constexpr static size_t _n = ((_max_size + _large_size_alignment - 1) >> 7) + 121;
-    static size_t _size_class[_n];
+    static_assert(size_class_size <= UINT8_MAX + 1, "size class does not fit in uint8_t");
+    using Table = std::array<uint8_t, _n>;
+    // 字节数到 size class 的映射表，编译期生成
+    static const Table _size_class;
 public:
-    // 返回任意字节对应的 size class，要求字节数不超过 max_size
-    static size_t get_size_class(size_t n) {
-        static std::once_flag flag;
-        std::call_once(flag, []() {
-            for(int i = 0, j = 0; i < size_class_size - 1; ++i) {
-                for(unsigned int mx = size_classes[i].size; j <= mx; j += sizeof(void *)) {
-                    _size_class[align(j)] = i;
-                }
-            }
-        });
+    // 返回任意字节对应的 size class，要求字节数不超过 max_size，0 字节返回 1
+    constexpr static size_t get_size_class(size_t n) {
         return _size_class[align(n)];
     }
 
+    // 字节数在编译期已知时，size class 也在编译期确定
+    template<size_t N>
+    constexpr static size_t size_class_of() {
+        static_assert(N <= _max_size, "larger than max thread cache size");
+        return std::integral_constant<size_t, get_size_class(N)>::value;
+    }
+
     // size_class 对应的 object 字节大小
-    static size_t size(size_t size_class) {
+    constexpr static size_t size(size_t size_class) {
         return size_classes[size_class].size;
     }
 
     // size_class 一次性申请/返还多少个 object，不会超过 max_move
-    static size_t num_to_move(size_t size_class) {
+    constexpr static size_t num_to_move(size_t size_class) {
         return size_classes[size_class].num_to_move;
     }
 
     // size_class 类型，一次申请多少页的 span 来切割成 objects
-    static size_t pages(size_t size_class) {
+    constexpr static size_t pages(size_t size_class) {
         return size_classes[size_class].pages;
     }
 
-    static size_t max_capacity(size_t size_class) {
+    constexpr static size_t max_capacity(size_t size_class) {
         return size_classes[size_class].max_capacity;
     }
-private:
-    static size_t align(size_t n);
-};
 
-size_t SizeMap::align(size_t n) {
-    if(n <= _large_size) {
-        return (n + 7) >> 3;
+    // size class 能够服务的最大字节数，超过的请求直接走 page heap
+    constexpr static size_t max_size() {
+        return _max_size;
     }
-    if(n <= _max_size) {
-        return (n + _large_size_alignment - 1 + (120 << 7)) >> 7;
+private:
+    constexpr static size_t align(size_t n) {
+        if(n <= _large_size) {
+            return (n + 7) >> 3;
+        }
+        if(n <= _max_size) {
+            return (n + _large_size_alignment - 1 + (120 << 7)) >> 7;
+        }
+
+        assert(n <= _max_size && "larger than max thread cache size");
+        return -1;
     }
 
-    assert(n <= _max_size && "larger than max thread cache size");
-    return -1;
+    constexpr static Table build_size_class();
+};
+
+constexpr SizeMap::Table SizeMap::build_size_class() {
+    Table table{};
+    // 0 字节也映射到最小的 size class，调用方不必单独处理
+    for(size_t i = 1, j = 0; i < size_class_size; ++i) {
+        for(size_t mx = size_classes[i].size; j <= mx; j += sizeof(void *)) {
+            table[align(j)] = static_cast<uint8_t>(i);
+        }
+    }
+    return table;
 }
 
+constexpr SizeMap::Table SizeMap::_size_class = SizeMap::build_size_class();
+
 #endif //MEMORYPOOL_SIZE_MAP_H
@@ -2,6 +2,8 @@
 #define MEMORYPOOL_SPAN_H
 #include <utility>
 #include <algorithm>
+#include <cstdint>
+#include <cassert>
 #include "free_list.h"
 #include "page.h"
 #include "intrusive_list.h"
@@ -19,21 +21,71 @@ public:
         USING,
         IDLE
     };
+
+    /* 切割成 object 之后，空闲 object 的两种记录方式：
+     * FREE_LIST：从未分配过的 object 用 bump 指针按需切出，归还的 object 串成链表，指针存放在 object 内部
+     * BITMAP：span 元数据中的位图，每个 object 一位，申请释放都不会访问 object 内存
+     */
+    enum class MODE{
+        FREE_LIST,
+        BITMAP
+    };
+
+    // 位图模式下一个 span 最多能容纳的 object 个数
+    constexpr static size_t max_bitmap_objects = 1024;
 private:
+    constexpr static size_t _bitmap_words = max_bitmap_objects / 64;
+
     Page _first_page;
     size_t _num_pages;
     STATUS _status;
 
     FreeList _list;
     size_t _allocated, _total;
+    // 0 表示 span 未被切割成 object（idle span 或直接分配给用户的 large span）
+    size_t _size_class;
+    // 所属 central cache shard
+    size_t _shard;
+    // 直接分配给用户的 large span 上记录用户申请的字节数
+    size_t _large_bytes;
+    // hugepage 模式下，从 hugepage filler / region 中切出的 span 所属的 PageTracker，由 page heap 解释
+    void* _tracker;
+
+    MODE _mode;
+    size_t _object_size;
+    // 链表模式下尚未切割部分的起始地址
+    char* _bump;
+    // 置位表示 object 空闲，_hint 之前的字全部为 0
+    size_t _hint;
+    uint64_t _bitmap[_bitmap_words];
+
+    // idle large span 在 page heap 的 SpanTree 上的左右子节点，以及插入时分配的随机优先级
+    friend class SpanTree;
+    Span* _left;
+    Span* _right;
+    uint32_t _priority;
 
 public:
     Span(void* ptr, size_t num_pages) : _first_page(ptr),
-        _num_pages(num_pages), _status(STATUS::IDLE), _list(), _allocated(0), _total(0) {}
+        _num_pages(num_pages), _status(STATUS::IDLE), _list(), _allocated(0), _total(0), _size_class(0), _shard(0), _large_bytes(0), _tracker(nullptr),
+        _mode(MODE::FREE_LIST), _object_size(0), _bump(nullptr), _hint(0), _bitmap(),
+        _left(nullptr), _right(nullptr), _priority(0) {}
 
     size_t alloc(void** batch, size_t n);
     void dealloc(void* ptr);
+    // 归还一组属于当前 span 的 object，链表模式下一次性接到链表头部
+    void dealloc_batch(void** batch, size_t n);
     void init_free_list(size_t size_obj);
+    // 以位图模式切割，要求 object 个数不超过 max_bitmap_objects
+    void init_bitmap(size_t size_obj);
+
+    // 遍历所有已分配的 object，只支持位图模式
+    template<typename F>
+    void for_each_allocated(F&& f) const;
+
+    [[nodiscard]] MODE mode() const {
+        return _mode;
+    }
 
     [[nodiscard]] bool empty() const {
         return _allocated == _total;
@@ -67,6 +119,38 @@ public:
         return _status;
     }
 
+    [[nodiscard]] size_t size_class() const {
+        return _size_class;
+    }
+
+    void size_class(size_t size_class) {
+        _size_class = size_class;
+    }
+
+    [[nodiscard]] size_t shard() const {
+        return _shard;
+    }
+
+    void shard(size_t shard) {
+        _shard = shard;
+    }
+
+    [[nodiscard]] size_t large_bytes() const {
+        return _large_bytes;
+    }
+
+    void large_bytes(size_t bytes) {
+        _large_bytes = bytes;
+    }
+
+    [[nodiscard]] void* tracker() const {
+        return _tracker;
+    }
+
+    void tracker(void* tracker) {
+        _tracker = tracker;
+    }
+
     [[nodiscard]] size_t allocated() const {
         return _allocated;
     }
@@ -93,25 +177,102 @@ public:
 };
 
 size_t Span::alloc(void** batch, size_t n) {
-    size_t cnt = std::min(n, _list.size());
-    _list.pop_batch(batch, cnt);
+    if(_mode == MODE::FREE_LIST) {
+        // 优先复用归还的 object，不够时再从未切割的部分切出
+        size_t cnt = std::min(n, _list.size());
+        _list.pop_batch(batch, cnt);
+        char* limit = static_cast<char*>(start_addr()) + _total * _object_size;
+        while(cnt < n && _bump < limit) {
+            batch[cnt++] = _bump;
+            _bump += _object_size;
+        }
+        _allocated += cnt;
+        return cnt;
+    }
+
+    // 从 _hint 开始逐字查找置位，tzcnt 得到空闲 object 的下标
+    char* start = static_cast<char*>(start_addr());
+    size_t cnt = 0;
+    for(size_t w = _hint; w < _bitmap_words && cnt < n; ++w) {
+        uint64_t bits = _bitmap[w];
+        while(bits != 0 && cnt < n) {
+            size_t idx = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            batch[cnt++] = start + idx * _object_size;
+        }
+        _bitmap[w] = bits;
+        if(bits == 0) _hint = w + 1;
+    }
     _allocated += cnt;
     return cnt;
 }
 
 void Span::dealloc(void* ptr) {
-    _list.push(ptr);
+    if(_mode == MODE::FREE_LIST) {
+        _list.push(ptr);
+        _allocated--;
+        return;
+    }
+
+    size_t idx = (static_cast<char*>(ptr) - static_cast<char*>(start_addr())) / _object_size;
+    assert(idx < _total && !(_bitmap[idx / 64] & (uint64_t(1) << (idx % 64))) && "double free in bitmap span");
+    _bitmap[idx / 64] |= uint64_t(1) << (idx % 64);
+    _hint = std::min(_hint, idx / 64);
     _allocated--;
 }
 
+void Span::dealloc_batch(void** batch, size_t n) {
+    if(_mode == MODE::FREE_LIST) {
+        _list.push_batch(batch, n);
+        _allocated -= n;
+        return;
+    }
+
+    for(size_t i = 0; i < n; ++i) {
+        dealloc(batch[i]);
+    }
+}
+
 void Span::init_free_list(size_t size_obj) {
-    char* start = static_cast<char*>(start_addr());
-    char* end = static_cast<char*>(end_addr());
+    // span 可能被 page heap 复用过，丢弃上一次切割留下的 free list
+    _mode = MODE::FREE_LIST;
+    _object_size = size_obj;
+    _list = FreeList();
+    _allocated = 0;
+    _total = num_bytes() / size_obj;
+    // 不在这里切割，申请时才按需切出，避免一次性访问整个 span 的内存
+    _bump = static_cast<char*>(start_addr());
+}
+void Span::init_bitmap(size_t size_obj) {
+    _mode = MODE::BITMAP;
+    _object_size = size_obj;
+    _list = FreeList();
     _allocated = 0;
-    _total = (end - start) / size_obj;
-    for(size_t i = 0; i < _total; ++i) {
-        _list.push(start);
-        start += size_obj;
+    _total = num_bytes() / size_obj;
+    assert(_total <= max_bitmap_objects && "too many objects for bitmap span");
+
+    // 只设置位图，不访问 object 内存
+    _hint = 0;
+    for(size_t w = 0; w < _bitmap_words; ++w) {
+        size_t bits = std::min(_total - std::min(_total, w * 64), size_t(64));
+        _bitmap[w] = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+    }
+}
+
+template<typename F>
+void Span::for_each_allocated(F&& f) const {
+    assert(_mode == MODE::BITMAP && "only bitmap span can enumerate objects");
+    char* start = static_cast<char*>(start_addr());
+    for(size_t w = 0; w * 64 < _total; ++w) {
+        size_t valid = std::min(_total - w * 64, size_t(64));
+        uint64_t mask = valid == 64 ? ~uint64_t(0) : (uint64_t(1) << valid) - 1;
+        // 清零位表示已分配
+        uint64_t bits = ~_bitmap[w] & mask;
+        while(bits != 0) {
+            size_t idx = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            f(static_cast<void*>(start + idx * _object_size));
+        }
     }
 }
 
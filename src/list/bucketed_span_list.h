@@ -0,0 +1,56 @@
+#ifndef MEMORYPOOL_BUCKETED_SPAN_LIST_H
+#define MEMORYPOOL_BUCKETED_SPAN_LIST_H
+#include <utility>
+#include "span.h"
+
+/* 按已分配比例把 span 分到若干链表中，比例越高桶号越大
+ * 申请时优先使用最满的 span，较空的 span 得不到新的分配，更容易全部归还回到 page heap
+ * 只保存还有空闲 object 的 span，分配完的 span 由调用方移除
+ */
+class BucketedSpanList {
+public:
+    [[nodiscard]] bool empty() const {
+        for(auto& list : _lists) {
+            if(!list.empty()) return false;
+        }
+        return true;
+    }
+
+    void insert(Span* span) {
+        _lists[bucket(span->allocated(), span->total())].prepend(span);
+    }
+
+    void remove(Span* span) {
+        // 侵入式链表移除不需要知道所在的桶
+        _lists[0].remove(span);
+    }
+
+    // 已分配比例最高的 span，没有时返回 nullptr
+    [[nodiscard]] Span* fullest() const {
+        for(size_t i = _num_buckets; i-- > 0;) {
+            if(!_lists[i].empty()) return _lists[i].first();
+        }
+        return nullptr;
+    }
+
+    // span 的已分配数量从 old_allocated 变化之后调用，必要时换桶
+    void update(Span* span, size_t old_allocated) {
+        if(bucket(old_allocated, span->total()) != bucket(span->allocated(), span->total())) {
+            remove(span);
+            insert(span);
+        }
+    }
+
+private:
+    static size_t bucket(size_t allocated, size_t total) {
+        // 链表中的 span 都还有空闲 object，allocated < total
+        return allocated * _num_buckets / total;
+    }
+
+private:
+    constexpr static size_t _num_buckets = 8;
+    SpanList _lists[_num_buckets];
+};
+
+
+#endif //MEMORYPOOL_BUCKETED_SPAN_LIST_H
@@ -6,6 +6,9 @@ class DynamicFreeList : public FreeList {
 public:
     DynamicFreeList() : _low_water(0), _max_length(1), _length_overages(0) {}
 
+    /* low water: 上次 clear_low_water 以来链表长度的最小值
+     * 这部分 object 在这段时间内一直没有被用到，scavenge 时可以归还
+     */
     [[nodiscard]] size_t low_water() const {
         return _low_water;
     }
@@ -59,10 +62,11 @@ private:
 };
 
 void* DynamicFreeList::pop() {
-    if(size() - 1 < _low_water) {
+    void* res = FreeList::pop();
+    if(size() < _low_water) {
         clear_low_water();
     }
-    return FreeList::pop();
+    return res;
 }
 
 void DynamicFreeList::pop_batch(void **batch, size_t n) {
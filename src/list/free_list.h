@@ -1,6 +1,7 @@
 #ifndef MEMORYPOOL_FREE_LIST_H
 #define MEMORYPOOL_FREE_LIST_H
 #include <utility>
+#include "attributes.h"
 
 class FreeList {
 private:
@@ -28,7 +29,12 @@ public:
     }
 
     void push_batch(void** batch, size_t n) {
+        if(n == 0) return;
+        // 每个 object 都要写入 next，提前几个 object 预取，写入时不必等待 cache miss
         for(size_t i = 0; i < n - 1; ++i) {
+            if(i + _prefetch_distance < n) {
+                MP_PREFETCH_WRITE(batch[i + _prefetch_distance]);
+            }
             sll_set_next(batch[i], batch[i + 1]);
         }
 
@@ -42,10 +48,14 @@ public:
             batch[i] = _list;
             _list = sll_next(_list);
         }
+        // 下一次 pop 要读新链表头中的 next
+        MP_PREFETCH(_list);
         _n -= n;
     }
 
 private:
+    constexpr static size_t _prefetch_distance = 4;
+
     static inline void* sll_next(void *ptr) {
         return *(reinterpret_cast<void**>(ptr));
     }
@@ -63,6 +73,8 @@ private:
         void* res = *list;
         void* next = sll_next(*list);
         *list = next;
+        // 下一次 pop 要读 next 中保存的指针，提前预取，避免那时 cache miss
+        MP_PREFETCH(next);
         return res;
     }
 };
@@ -0,0 +1,128 @@
+#ifndef MEMORYPOOL_SPAN_TREE_H
+#define MEMORYPOOL_SPAN_TREE_H
+#include <utility>
+#include "span.h"
+
+/* 按 (页数, 起始地址) 排序的侵入式 treap，管理 page heap 中的 large span
+ * best_fit 返回页数足够的 span 中最小的，页数相同时取地址最低的，
+ * 大块申请优先复用大小最接近、地址最靠前的空闲区域，减少碎片
+ * 节点优先级在插入时由每棵树自己的 xorshift 生成，与插入顺序、键的大小无关，树高期望为 O(log n)，
+ * split/merge 的递归深度随之有界
+ * 不加锁，由 page heap 的锁保护；span 在树上期间不能修改页数和起始页
+ */
+class SpanTree {
+public:
+    SpanTree() : _root(nullptr), _size(0), _seed(0x9E3779B97F4A7C15ull) {}
+
+    [[nodiscard]] bool empty() const {
+        return _root == nullptr;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return _size;
+    }
+
+    // 树上任意一个 span，没有时返回 nullptr
+    [[nodiscard]] Span* root() const {
+        return _root;
+    }
+
+    void insert(Span* span);
+    void remove(Span* span);
+    // 页数不小于 n 的 span 中最小、地址最低的一个，没有时返回 nullptr
+    [[nodiscard]] Span* best_fit(size_t n) const;
+
+private:
+    static bool less(const Span* a, const Span* b) {
+        if(a->num_pages() != b->num_pages()) return a->num_pages() < b->num_pages();
+        return a->first_page().id() < b->first_page().id();
+    }
+
+    // xorshift64，取高 32 位作为优先级
+    uint32_t next_priority() {
+        _seed ^= _seed << 13;
+        _seed ^= _seed >> 7;
+        _seed ^= _seed << 17;
+        return static_cast<uint32_t>(_seed >> 32);
+    }
+
+    // 拆成小于 key 与不小于 key 的两棵树
+    static void split(Span* root, const Span* key, Span*& l, Span*& r);
+    // l 中所有节点都小于 r 中的节点
+    static Span* merge(Span* l, Span* r);
+    static void remove(Span*& root, Span* span);
+
+private:
+    Span* _root;
+    size_t _size;
+    uint64_t _seed;
+};
+
+void SpanTree::split(Span* root, const Span* key, Span*& l, Span*& r) {
+    if(root == nullptr) {
+        l = r = nullptr;
+        return;
+    }
+    if(less(root, key)) {
+        split(root->_right, key, root->_right, r);
+        l = root;
+    } else {
+        split(root->_left, key, l, root->_left);
+        r = root;
+    }
+}
+
+Span* SpanTree::merge(Span* l, Span* r) {
+    if(l == nullptr) return r;
+    if(r == nullptr) return l;
+    if(l->_priority > r->_priority) {
+        l->_right = merge(l->_right, r);
+        return l;
+    }
+    r->_left = merge(l, r->_left);
+    return r;
+}
+
+void SpanTree::insert(Span* span) {
+    span->_left = span->_right = nullptr;
+    span->_priority = next_priority();
+    Span* l = nullptr;
+    Span* r = nullptr;
+    split(_root, span, l, r);
+    _root = merge(merge(l, span), r);
+    ++_size;
+}
+
+void SpanTree::remove(Span*& root, Span* span) {
+    assert(root != nullptr && "span is not in the tree");
+    if(root == span) {
+        root = merge(span->_left, span->_right);
+    } else if(less(span, root)) {
+        remove(root->_left, span);
+    } else {
+        remove(root->_right, span);
+    }
+}
+
+void SpanTree::remove(Span* span) {
+    remove(_root, span);
+    span->_left = span->_right = nullptr;
+    --_size;
+}
+
+Span* SpanTree::best_fit(size_t n) const {
+    Span* res = nullptr;
+    Span* node = _root;
+    while(node != nullptr) {
+        if(node->num_pages() >= n) {
+            res = node;
+            node = node->_left;
+        } else {
+            node = node->_right;
+        }
+    }
+    return res;
+}
+
+
+#endif //MEMORYPOOL_SPAN_TREE_H
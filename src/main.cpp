@@ -7,6 +7,7 @@
 #include "page_heap.h"
 #include "central_cache.h"
 #include "thread_cache.h"
+#include "memory_pool.h"
 
 void test_system() {
     auto& sa = Singleton<SystemAlloc>::get_instance();
@@ -45,8 +46,8 @@ void test_central_cache() {
 }
 
 void test_thread_cache() {
-    auto tc = ThreadCache::tc;
-    std::cout << tc.get() << std::endl;
+    auto tc = ThreadCache::get();
+    std::cout << tc << std::endl;
     const int m = 3000;
     void* objects[m];
     for(int i = 1; i < m; ++i) {
@@ -57,6 +58,17 @@ void test_thread_cache() {
     }
 }
 
+void test_memory_pool() {
+    const int m = 3000;
+    void* objects[m];
+    for(int i = 1; i < m; ++i) {
+        objects[i] = mp_malloc(i * 97);
+    }
+    for(int i = 1; i < m; ++i) {
+        mp_free(objects[i]);
+    }
+}
+
 int main() {
     spdlog::set_default_logger(spdlog::stdout_color_mt("memory pool"));
     spdlog::set_level(spdlog::level::info);
@@ -66,6 +78,7 @@ int main() {
     // test_page_heap();
     // test_central_cache();
     // test_thread_cache();
+    // test_memory_pool();
 
     std::thread t1(test_thread_cache);
 
@@ -74,8 +87,12 @@ int main() {
     t1.join();
     t2.join();
 
+    SingleCpuCache::destroy();
+
     SingleCentralCahce::destroy();
 
+    SingleLargeCache::destroy();
+
     SinglePageHeap::destroy();
 
     SingleSystemAlloc::destroy();
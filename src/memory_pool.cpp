@@ -0,0 +1,3 @@
+// libmemorypool.so 唯一的编译单元，通过 LD_PRELOAD 替换 glibc 的 malloc 系列函数以及全局 operator new/delete
+#include "libc_override.h"
+#include "new_delete.h"
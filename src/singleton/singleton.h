@@ -2,29 +2,60 @@
 #define MEMORYPOOL_SINGLETON_H
 #include <mutex>
 #include <memory>
+#include <atomic>
+#include <new>
+#include "attributes.h"
 
+/* 实例构造在静态存储区上，不随进程退出自动析构：
+ * 退出阶段其它静态对象析构时仍可能释放内存，各层单例必须活到最后，只能显式 destroy
+ */
 template<typename T>
 class Singleton {
 public:
+    // 构造完成之后只需一次 load，不再经过 call_once
     static T& get_instance() {
+        T* instance = _instance.load(std::memory_order_acquire);
+        if(MP_LIKELY(instance != nullptr)) return *instance;
+        return create();
+    }
+
+    static void destroy() {
         static std::once_flag flag;
         std::call_once(flag, [&]() {
-            _instance = std::unique_ptr<T>(new T());
+            T* instance = _instance.load(std::memory_order_acquire);
+            if(instance == nullptr) return;
+            _destroyed.store(true, std::memory_order_relaxed);
+            instance->~T();
+            _instance.store(nullptr, std::memory_order_release);
         });
-        return *_instance;
     }
 
-    static void destroy() {
+    // destroy 之后不能再使用 get_instance
+    static bool destroyed() {
+        return _destroyed.load(std::memory_order_relaxed);
+    }
+private:
+    MP_NOINLINE static T& create() {
         static std::once_flag flag;
         std::call_once(flag, [&]() {
-            _instance.reset(nullptr);
+            _instance.store(new(_storage) T(), std::memory_order_release);
         });
+        return *_instance.load(std::memory_order_acquire);
     }
+
 private:
-    static std::unique_ptr<T> _instance;
+    alignas(T) static unsigned char _storage[sizeof(T)];
+    static std::atomic<T*> _instance;
+    static std::atomic<bool> _destroyed;
 };
 
 template<typename T>
-std::unique_ptr<T> Singleton<T>::_instance = nullptr;
+alignas(T) unsigned char Singleton<T>::_storage[sizeof(T)];
+
+template<typename T>
+std::atomic<T*> Singleton<T>::_instance = nullptr;
+
+template<typename T>
+std::atomic<bool> Singleton<T>::_destroyed = false;
 
 #endif //MEMORYPOOL_SINGLETON_H
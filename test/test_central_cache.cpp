@@ -1,4 +1,17 @@
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <set>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <sys/mman.h>
 #include "gtest/gtest.h"
+#include "bucketed_span_list.h"
+#include "adaptive_lock.h"
+#include "batch_stack.h"
+#include "span_tree.h"
+#include "huge_page_filler.h"
 
 int hello() {
     return 0;
@@ -10,4 +23,253 @@ TEST(hello, hello) {
 
 TEST(hello, hello1) {
     EXPECT_EQ(0, hello());
-}
\ No newline at end of file
+}
+TEST(bucketed_span_list, fullest_first) {
+    void* mem = aligned_alloc(Page::SIZE, Page::SIZE * 3);
+    Span spans[3] = {{mem, 1}, {static_cast<char*>(mem) + Page::SIZE, 1},
+                     {static_cast<char*>(mem) + Page::SIZE * 2, 1}};
+    void* batch[1024];
+    BucketedSpanList list;
+    for(auto& span : spans) {
+        span.init_free_list(64);
+        list.insert(&span);
+    }
+    EXPECT_FALSE(list.empty());
+
+    // 已分配比例越高越先被选中
+    size_t old = spans[1].allocated();
+    spans[1].alloc(batch, spans[1].total() / 2);
+    list.update(&spans[1], old);
+    EXPECT_EQ(list.fullest(), &spans[1]);
+
+    old = spans[2].allocated();
+    spans[2].alloc(batch, spans[2].total() - 1);
+    list.update(&spans[2], old);
+    EXPECT_EQ(list.fullest(), &spans[2]);
+
+    list.remove(&spans[2]);
+    EXPECT_EQ(list.fullest(), &spans[1]);
+    list.remove(&spans[1]);
+    list.remove(&spans[0]);
+    EXPECT_TRUE(list.empty());
+    EXPECT_EQ(list.fullest(), nullptr);
+    free(mem);
+}
+
+TEST(span, bitmap) {
+    constexpr size_t size = 24;
+    void* mem = aligned_alloc(Page::SIZE, Page::SIZE);
+    Span span(mem, 1);
+    span.init_bitmap(size);
+    EXPECT_EQ(span.mode(), Span::MODE::BITMAP);
+    size_t total = span.total();
+    EXPECT_EQ(total, Page::SIZE / size);
+
+    // 按地址顺序分配，全部分配完之后不再有 object
+    std::vector<void*> batch(total + 1);
+    EXPECT_EQ(span.alloc(batch.data(), total + 1), total);
+    EXPECT_TRUE(span.empty());
+    for(size_t i = 0; i < total; ++i) {
+        EXPECT_EQ(batch[i], static_cast<char*>(mem) + i * size);
+    }
+
+    // 释放一部分，可以枚举出剩下的已分配 object
+    for(size_t i = 0; i < total; i += 3) {
+        span.dealloc(batch[i]);
+    }
+    size_t live = 0;
+    span.for_each_allocated([&](void* ptr) {
+        size_t idx = (static_cast<char*>(ptr) - static_cast<char*>(mem)) / size;
+        EXPECT_NE(idx % 3, 0);
+        ++live;
+    });
+    EXPECT_EQ(live, span.allocated());
+
+    // 释放的 object 可以再次分配
+    size_t freed = total - span.allocated();
+    EXPECT_EQ(span.alloc(batch.data(), total), freed);
+    EXPECT_TRUE(span.empty());
+    for(size_t i = 0; i < total; ++i) {
+        span.dealloc(static_cast<char*>(mem) + i * size);
+    }
+    EXPECT_TRUE(span.full());
+    free(mem);
+}
+
+TEST(span, lazy_carve) {
+    constexpr size_t pages = 4;
+    void* mem = mmap(nullptr, Page::SIZE * pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(mem, MAP_FAILED);
+    // 先对齐到 Page::SIZE
+    void* start = reinterpret_cast<void*>((reinterpret_cast<size_t>(mem) + Page::SIZE - 1) & ~(Page::SIZE - 1));
+    Span span(start, 1);
+    span.init_free_list(8);
+    EXPECT_EQ(span.total(), Page::SIZE / 8);
+
+    // 初始化和申请都不会访问 object 内存
+    void* batch[32];
+    EXPECT_EQ(span.alloc(batch, 32), 32);
+    unsigned char vec[pages];
+    ASSERT_EQ(mincore(mem, Page::SIZE * pages, vec), 0);
+    for(auto v : vec) {
+        EXPECT_EQ(v & 1, 0);
+    }
+
+    // 归还的 object 优先被复用，之后继续切割剩下的部分
+    span.dealloc(batch[5]);
+    void* ptr = nullptr;
+    EXPECT_EQ(span.alloc(&ptr, 1), 1);
+    EXPECT_EQ(ptr, batch[5]);
+    EXPECT_EQ(span.alloc(&ptr, 1), 1);
+    EXPECT_EQ(ptr, static_cast<char*>(start) + 32 * 8);
+
+    std::vector<void*> rest(span.total());
+    EXPECT_EQ(span.alloc(rest.data(), rest.size()), span.total() - 33);
+    EXPECT_TRUE(span.empty());
+    munmap(mem, Page::SIZE * pages);
+}
+
+TEST(adaptive_lock, mutual_exclusion) {
+    AdaptiveLock lock;
+    size_t counter = 0;
+    auto work = [&]() {
+        for(int i = 0; i < 100000; ++i) {
+            std::lock_guard<AdaptiveLock> lg(lock);
+            ++counter;
+        }
+    };
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; ++i) {
+        threads.emplace_back(work);
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(counter, 400000);
+
+    EXPECT_TRUE(lock.try_lock());
+    EXPECT_FALSE(lock.try_lock());
+    lock.unlock();
+
+    LockStats stats = lock.stats();
+    EXPECT_EQ(stats.acquisitions, 400001);
+    EXPECT_LE(stats.contended, stats.acquisitions);
+    EXPECT_EQ(sizeof(AdaptiveLock), 64);
+}
+
+TEST(batch_stack, concurrent) {
+    constexpr size_t size_class = SizeMap::size_class_of<64>();
+    constexpr size_t n = SizeMap::num_to_move(size_class);
+    std::vector<void*> slots(BatchStack::max_objects);
+    BatchStack stack;
+    stack.init(size_class, slots.data());
+    ASSERT_GE(stack.capacity(), n);
+
+    // 每个线程反复放入、取出自己的一批，结束后所有批次原样取回
+    constexpr int num_threads = 4;
+    std::vector<std::vector<void*>> owned(num_threads, std::vector<void*>(n));
+    for(int t = 0; t < num_threads; ++t) {
+        for(size_t i = 0; i < n; ++i) {
+            owned[t][i] = reinterpret_cast<void*>((t * n + i + 1) * 8);
+        }
+    }
+    std::vector<std::thread> threads;
+    for(int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<void*> batch(owned[t]);
+            for(int round = 0; round < 20000; ++round) {
+                if(stack.insert_range(batch.data(), n)) {
+                    while(stack.remove_range(batch.data(), n) != n) {}
+                }
+            }
+            owned[t] = batch;
+        });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(stack.size(), 0);
+
+    std::vector<void*> all;
+    for(auto& batch : owned) {
+        all.insert(all.end(), batch.begin(), batch.end());
+    }
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(std::unique(all.begin(), all.end()), all.end());
+    EXPECT_EQ(all.size(), num_threads * n);
+}
+
+TEST(span_tree, best_fit) {
+    // span 只用到起始地址和页数，不访问对应内存
+    constexpr size_t num_spans = 2000;
+    std::vector<Span> spans;
+    spans.reserve(num_spans);
+    std::mt19937_64 rng(7);
+    for(size_t i = 0; i < num_spans; ++i) {
+        spans.emplace_back(reinterpret_cast<void*>((i + 1) * (size_t(1) << 30)), 129 + rng() % 64);
+    }
+
+    // 与按 (页数, 地址) 排序的 std::set 对照
+    auto key = [](const Span* s) { return std::make_pair(s->num_pages(), s->first_page().id()); };
+    std::set<std::pair<size_t, size_t>> expect;
+    SpanTree tree;
+    std::vector<bool> in_tree(num_spans, false);
+    for(int round = 0; round < 20000; ++round) {
+        size_t i = rng() % num_spans;
+        if(in_tree[i]) {
+            tree.remove(&spans[i]);
+            expect.erase(key(&spans[i]));
+        } else {
+            tree.insert(&spans[i]);
+            expect.insert(key(&spans[i]));
+        }
+        in_tree[i] = !in_tree[i];
+
+        size_t n = 129 + rng() % 70;
+        Span* res = tree.best_fit(n);
+        auto it = expect.lower_bound({n, 0});
+        if(it == expect.end()) {
+            ASSERT_EQ(res, nullptr);
+        } else {
+            ASSERT_NE(res, nullptr);
+            ASSERT_EQ(key(res), *it);
+        }
+    }
+    EXPECT_EQ(tree.size(), expect.size());
+}
+
+TEST(huge_page_filler, dense_packing) {
+    // tracker 只用到 backing span 的起始地址和页数，不访问对应内存
+    constexpr size_t num = 4;
+    std::vector<Span> backing;
+    std::vector<HugePageFiller::Tracker> trackers;
+    backing.reserve(num);
+    trackers.reserve(num);
+    HugePageFiller filler;
+    for(size_t i = 0; i < num; ++i) {
+        backing.emplace_back(reinterpret_cast<void*>((i + 1) * Page::HUGE_SIZE), Page::PER_HUGE);
+        trackers.emplace_back(&backing[i]);
+        filler.add(&trackers[i]);
+    }
+
+    // 优先放进最长空闲区间最短的 hugepage
+    size_t off = 0;
+    HugePageFiller::Tracker* a = filler.alloc(200, off);
+    ASSERT_NE(a, nullptr);
+    HugePageFiller::Tracker* b = filler.alloc(50, off);
+    EXPECT_EQ(b, a);
+    EXPECT_EQ(off, 200);
+    HugePageFiller::Tracker* c = filler.alloc(100, off);
+    ASSERT_NE(c, nullptr);
+    EXPECT_NE(c, a);
+    EXPECT_EQ(filler.alloc(6, off), a);
+    EXPECT_EQ(a->longest_free(), 0);
+    EXPECT_EQ(filler.used_pages(), 356);
+
+    // hugepage 完全空闲时移出 filler
+    EXPECT_FALSE(filler.dealloc(a, 0, 200));
+    EXPECT_EQ(a->longest_free(), 200);
+    EXPECT_TRUE(filler.dealloc(c, 0, 100));
+    EXPECT_EQ(filler.hugepages(), num - 1);
+    EXPECT_EQ(filler.alloc(Page::PER_HUGE + 1, off), nullptr);
+}
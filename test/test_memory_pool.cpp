@@ -0,0 +1,566 @@
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <vector>
+#include "gtest/gtest.h"
+#include "memory_pool.h"
+
+TEST(memory_pool, malloc_free) {
+    std::vector<void*> ptrs;
+    for(size_t n = 0; n <= SizeMap::max_size(); n += 97) {
+        void* ptr = mp_malloc(n);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_GE(mp_malloc_usable_size(ptr), n);
+        memset(ptr, 0xff, n);
+        ptrs.push_back(ptr);
+    }
+    for(auto ptr : ptrs) {
+        mp_free(ptr);
+    }
+    mp_free(nullptr);
+}
+
+TEST(memory_pool, large) {
+    for(size_t n : {SizeMap::max_size() + 1, size_t(1) << 20, size_t(3) << 20, size_t(9) << 20}) {
+        void* ptr = mp_malloc(n);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_GE(mp_malloc_usable_size(ptr), n);
+        memset(ptr, 0xff, n);
+        mp_free(ptr);
+    }
+}
+
+TEST(memory_pool, calloc) {
+    void* dirty = mp_malloc(100);
+    memset(dirty, 0xff, 100);
+    mp_free(dirty);
+
+    auto ptr = static_cast<unsigned char*>(mp_calloc(10, 10));
+    ASSERT_NE(ptr, nullptr);
+    for(int i = 0; i < 100; ++i) {
+        EXPECT_EQ(ptr[i], 0);
+    }
+    mp_free(ptr);
+
+    EXPECT_EQ(mp_calloc(SIZE_MAX, 2), nullptr);
+}
+
+TEST(memory_pool, realloc) {
+    auto ptr = static_cast<char*>(mp_realloc(nullptr, 16));
+    ASSERT_NE(ptr, nullptr);
+    for(int i = 0; i < 16; ++i) ptr[i] = char(i);
+
+    for(size_t n : {size_t(100), size_t(5000), size_t(1) << 19, size_t(64)}) {
+        ptr = static_cast<char*>(mp_realloc(ptr, n));
+        ASSERT_NE(ptr, nullptr);
+        for(int i = 0; i < 16; ++i) {
+            EXPECT_EQ(ptr[i], char(i));
+        }
+    }
+    EXPECT_EQ(mp_realloc(ptr, 0), nullptr);
+}
+
+TEST(memory_pool, aligned_alloc) {
+    for(size_t align = 1; align <= (size_t(1) << 21); align <<= 1) {
+        for(size_t n : {size_t(1), size_t(100), size_t(10000), size_t(300000)}) {
+            void* ptr = mp_aligned_alloc(align, n);
+            ASSERT_NE(ptr, nullptr);
+            EXPECT_EQ(reinterpret_cast<size_t>(ptr) % align, 0);
+            EXPECT_GE(mp_malloc_usable_size(ptr), n);
+            memset(ptr, 0xff, n);
+            mp_free(ptr);
+        }
+    }
+    EXPECT_EQ(mp_aligned_alloc(24, 100), nullptr);
+}
+
+TEST(memory_pool, multi_thread) {
+    auto work = []() {
+        std::vector<void*> ptrs;
+        for(size_t i = 1; i < 20000; ++i) {
+            ptrs.push_back(mp_malloc(i * 13 % 4096));
+        }
+        for(auto ptr : ptrs) {
+            mp_free(ptr);
+        }
+    };
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; ++i) {
+        threads.emplace_back(work);
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+}
+
+TEST(memory_pool, per_cpu) {
+    const char* env = getenv("MEMORYPOOL_PER_CPU");
+    if(env == nullptr || strcmp(env, "1") != 0) {
+        GTEST_SKIP() << "per-cpu cache disabled";
+    }
+    EXPECT_TRUE(SingleCpuCache::get_instance().active());
+    // 确认之后快路径直接使用缓存在 TLS 中的 rseq 区域
+    EXPECT_NE(CpuCache::current(), nullptr);
+
+    // 同一 size class 反复申请释放，object 不能重复分配
+    std::vector<char*> ptrs;
+    for(int i = 0; i < 10000; ++i) {
+        auto ptr = static_cast<char*>(mp_malloc(64));
+        ASSERT_NE(ptr, nullptr);
+        memset(ptr, i & 0xff, 64);
+        ptrs.push_back(ptr);
+    }
+    for(int i = 0; i < 10000; ++i) {
+        EXPECT_EQ(ptrs[i][63], char(i & 0xff));
+        mp_free(ptrs[i]);
+    }
+}
+
+TEST(memory_pool, thread_cache_budget) {
+    auto& budget = SingleThreadCacheBudget::get_instance();
+    size_t overall = budget.overall_bytes();
+    // 够每个线程拿到一份最小额度
+    budget.overall_bytes(8 * ThreadCacheBudget::min_bytes);
+
+    auto work = []() {
+        std::vector<void*> ptrs;
+        for(int i = 0; i < 20000; ++i) {
+            ptrs.push_back(mp_malloc(1000 + i % 3000));
+        }
+        for(auto ptr : ptrs) {
+            mp_free(ptr);
+        }
+        ThreadCache* tc = ThreadCache::get();
+        if(tc != nullptr) {
+            // 超出额度后会收缩，缓存量不会远超额度
+            EXPECT_LE(tc->total_bytes(), tc->max_bytes() + ThreadCacheBudget::steal_bytes);
+        }
+    };
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; ++i) {
+        threads.emplace_back(work);
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+
+    budget.overall_bytes(overall);
+}
+
+TEST(memory_pool, thread_cache_budget_many_threads) {
+    if(SingleCpuCache::get_instance().active()) {
+        GTEST_SKIP() << "thread cache bypassed by per-cpu cache";
+    }
+    auto& budget = SingleThreadCacheBudget::get_instance();
+    size_t overall = budget.overall_bytes();
+    constexpr size_t limit = 1 << 20;
+    budget.overall_bytes(limit);
+
+    // 线程数超过 limit / min_bytes，后来的线程拿不到完整的最小额度
+    constexpr size_t num_threads = 4 * limit / ThreadCacheBudget::min_bytes;
+    std::vector<ThreadCache*> caches(num_threads, nullptr);
+    std::atomic<size_t> done(0);
+    std::atomic<bool> finish(false);
+    auto work = [&](size_t k) {
+        std::vector<void*> ptrs;
+        for(int i = 0; i < 5000; ++i) {
+            ptrs.push_back(mp_malloc(1000 + i % 3000));
+        }
+        for(auto ptr : ptrs) {
+            mp_free(ptr);
+        }
+        caches[k] = ThreadCache::get();
+        done.fetch_add(1);
+        // 全部线程都还活着时检查，退出的线程会交还额度
+        while(!finish.load()) {
+            std::this_thread::yield();
+        }
+    };
+    std::vector<std::thread> threads;
+    for(size_t k = 0; k < num_threads; ++k) {
+        threads.emplace_back(work, k);
+    }
+    while(done.load() != num_threads) {
+        std::this_thread::yield();
+    }
+
+    // 各线程额度之和不超过总预算，缓存量只会因未到慢路径而略超额度
+    size_t max_bytes = 0, total_bytes = 0;
+    for(auto tc : caches) {
+        ASSERT_NE(tc, nullptr);
+        max_bytes += tc->max_bytes();
+        total_bytes += tc->total_bytes();
+    }
+    EXPECT_LE(max_bytes, limit);
+    EXPECT_LE(total_bytes, limit + num_threads * ThreadCacheBudget::steal_bytes);
+
+    finish.store(true);
+    for(auto& t : threads) {
+        t.join();
+    }
+    budget.overall_bytes(overall);
+}
+
+TEST(memory_pool, scavenge) {
+    if(SingleCpuCache::get_instance().active()) {
+        GTEST_SKIP() << "thread cache bypassed by per-cpu cache";
+    }
+    std::thread t([]() {
+        std::vector<void*> ptrs;
+        for(int i = 0; i < 1000; ++i) {
+            ptrs.push_back(mp_malloc(64));
+        }
+        for(auto ptr : ptrs) {
+            mp_free(ptr);
+        }
+        ThreadCache* tc = ThreadCache::get();
+        ASSERT_NE(tc, nullptr);
+        // 第一次 scavenge 重置 low water，之后这些 object 一直没被用到
+        tc->scavenge();
+        size_t idle = tc->total_bytes();
+        ASSERT_GT(idle, 0);
+        tc->scavenge();
+        EXPECT_LE(tc->total_bytes(), idle / 2 + 64);
+
+        // 反复 scavenge 后，长期不用的 object 全部归还
+        for(int i = 0; i < 64; ++i) {
+            tc->scavenge();
+        }
+        EXPECT_EQ(tc->total_bytes(), 0);
+    });
+    t.join();
+}
+
+TEST(memory_pool, scavenge_request) {
+    if(SingleCpuCache::get_instance().active()) {
+        GTEST_SKIP() << "thread cache bypassed by per-cpu cache";
+    }
+    std::atomic<int> phase(0);
+    std::thread t([&phase]() {
+        std::vector<void*> ptrs;
+        for(int i = 0; i < 1000; ++i) {
+            ptrs.push_back(mp_malloc(64));
+        }
+        for(auto ptr : ptrs) {
+            mp_free(ptr);
+        }
+        ThreadCache* tc = ThreadCache::get();
+        ASSERT_NE(tc, nullptr);
+        tc->scavenge();
+        size_t idle = tc->total_bytes();
+        ASSERT_GT(idle, 0);
+        phase.store(1);
+        while(phase.load() != 2) {
+            std::this_thread::yield();
+        }
+
+        // 请求之后一直空闲的线程不会响应，object 仍留在 thread cache 中
+        EXPECT_EQ(tc->total_bytes(), idle);
+
+        // 下一次进入慢路径时才执行 scavenge
+        constexpr size_t size_class = SizeMap::size_class_of<3000>();
+        void* ptr = mp_malloc(3000);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_LE(tc->total_bytes(), idle / 2 + 64 + SizeMap::num_to_move(size_class) * SizeMap::size(size_class));
+        mp_free(ptr);
+    });
+    while(phase.load() != 1) {
+        std::this_thread::yield();
+    }
+    ThreadCache::request_scavenge();
+    phase.store(2);
+    t.join();
+}
+
+TEST(memory_pool, thread_cache_recycle) {
+    // 线程退出后 thread cache 归还全部 object，并被下一个线程复用
+    ThreadCache* prev = nullptr;
+    for(int i = 0; i < 100; ++i) {
+        ThreadCache* cur = nullptr;
+        std::thread t([&cur]() {
+            void* ptr = mp_malloc(128);
+            cur = ThreadCache::get();
+            mp_free(ptr);
+        });
+        t.join();
+        ASSERT_NE(cur, nullptr);
+        if(prev != nullptr) {
+            EXPECT_EQ(cur, prev);
+            EXPECT_EQ(cur->total_bytes(), 0);
+        }
+        prev = cur;
+    }
+}
+
+TEST(memory_pool, size_map) {
+    static_assert(SizeMap::size_class_of<0>() == 1, "");
+    static_assert(SizeMap::size_class_of<1>() == 1, "");
+    static_assert(SizeMap::size(SizeMap::size_class_of<100>()) >= 100, "");
+    static_assert(SizeMap::size_class_of<SizeMap::max_size()>() == SizeMap::size_class_size - 1, "");
+
+    // 每个字节数都映射到能放下它的最小 size class
+    for(size_t n = 1; n <= SizeMap::max_size(); ++n) {
+        size_t size_class = SizeMap::get_size_class(n);
+        ASSERT_GE(SizeMap::size(size_class), n);
+        ASSERT_LT(SizeMap::size(size_class - 1), n);
+    }
+}
+
+TEST(memory_pool, batch) {
+    for(size_t size : {size_t(0), size_t(24), size_t(1000), SizeMap::max_size(), SizeMap::max_size() + 1}) {
+        for(size_t n : {size_t(1), size_t(10), size_t(5000)}) {
+            // 最大的 size class 一次 5000 个要上 GB，10 个已经能覆盖 span 补充路径
+            if(size >= SizeMap::max_size() && n > 10) continue;
+            std::vector<void*> batch(n, nullptr);
+            ASSERT_EQ(mp_alloc_batch(size, batch.data(), n), n);
+            for(size_t i = 0; i < n; ++i) {
+                ASSERT_NE(batch[i], nullptr);
+                EXPECT_GE(mp_malloc_usable_size(batch[i]), size);
+                memset(batch[i], int(i & 0xff), size);
+            }
+            // object 之间互不重叠
+            std::vector<void*> sorted(batch);
+            std::sort(sorted.begin(), sorted.end());
+            EXPECT_EQ(std::unique(sorted.begin(), sorted.end()), sorted.end());
+            for(size_t i = 0; i < n && size > 0; ++i) {
+                EXPECT_EQ(static_cast<unsigned char*>(batch[i])[size - 1], i & 0xff);
+            }
+            mp_free_batch(size, batch.data(), n);
+        }
+    }
+}
+
+TEST(memory_pool, transfer_cache) {
+    // 整批归还的 object 进入 transfer cache，下一次整批申请原样取回
+    auto& cc = SingleCentralCahce::get_instance();
+    if(cc.num_shards() > 1) {
+        GTEST_SKIP() << "two calls may land on different shards";
+    }
+    constexpr size_t size_class = SizeMap::size_class_of<64>();
+    constexpr size_t n = SizeMap::num_to_move(size_class);
+    void* batch[n];
+    ASSERT_EQ(cc.alloc(size_class, batch, n), n);
+    cc.dealloc(size_class, batch, n);
+
+    void* again[n];
+    ASSERT_EQ(cc.alloc(size_class, again, n), n);
+    for(size_t i = 0; i < n; ++i) {
+        EXPECT_EQ(again[i], batch[i]);
+    }
+    cc.dealloc(size_class, again, n);
+}
+
+TEST(memory_pool, central_shards) {
+    const char* env = getenv("MEMORYPOOL_CENTRAL_SHARDS");
+    size_t expect = env == nullptr ? 1 : std::stoul(env);
+    EXPECT_EQ(SingleCentralCahce::get_instance().num_shards(), expect);
+
+    // 各线程可能落在不同 shard，object 释放时回到其 span 所在的 shard
+    auto work = []() {
+        std::vector<void*> ptrs;
+        for(int i = 0; i < 20000; ++i) {
+            ptrs.push_back(mp_malloc(48));
+        }
+        mp_free_batch(48, ptrs.data(), ptrs.size());
+    };
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 8; ++i) {
+        threads.emplace_back(work);
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+}
+
+TEST(memory_pool, release_to_spans) {
+    auto& cc = SingleCentralCahce::get_instance();
+    auto& ph = SinglePageHeap::get_instance();
+    auto& pm = SinglePageMap::get_instance();
+    constexpr size_t size_class = SizeMap::size_class_of<2048>();
+
+    // span 直接从 page heap 申请并自行切割，不与其它测试共享；两种模式交替，归还路径都要支持
+    std::vector<Span*> spans;
+    std::vector<std::vector<void*>> owned;
+    for(size_t i = 0; i < 4; ++i) {
+        Span* span = ph.alloc(SizeMap::pages(size_class));
+        ASSERT_NE(span, nullptr);
+        if(i % 2 == 0) {
+            span->init_free_list(SizeMap::size(size_class));
+        } else {
+            span->init_bitmap(SizeMap::size(size_class));
+        }
+        span->size_class(size_class);
+        span->shard(0);
+        std::vector<void*> ptrs(span->total());
+        ASSERT_EQ(span->alloc(ptrs.data(), ptrs.size()), ptrs.size());
+        ASSERT_TRUE(span->empty());
+        spans.push_back(span);
+        owned.push_back(ptrs);
+    }
+
+    // 各 span 的 object 交错排列，每个 span 先留下一个
+    std::vector<void*> interleaved;
+    for(size_t i = 1; i < owned[0].size(); ++i) {
+        for(auto& ptrs : owned) {
+            interleaved.push_back(ptrs[i]);
+        }
+    }
+    cc.release_to_spans(size_class, interleaved.data(), interleaved.size());
+    for(auto span : spans) {
+        EXPECT_EQ(span->allocated(), 1);
+        EXPECT_EQ(span->status(), Span::STATUS::USING);
+    }
+
+    // 归还每个 span 留下的最后一个 object 后，span 全部回到 page heap
+    std::vector<void*> last;
+    for(auto& ptrs : owned) {
+        last.push_back(ptrs[0]);
+    }
+    cc.release_to_spans(size_class, last.data(), last.size());
+    for(auto ptr : last) {
+        Span* span = pm.find_span(ptr);
+        EXPECT_TRUE(span == nullptr || span->status() == Span::STATUS::IDLE);
+    }
+}
+
+TEST(memory_pool, page_map) {
+    auto& pm = SinglePageMap::get_instance();
+    // 使用中的 span 每一页都能查到
+    size_t n = size_t(3) << 20;
+    auto ptr = static_cast<char*>(mp_malloc(n));
+    ASSERT_NE(ptr, nullptr);
+    Span* span = pm.find_span(ptr);
+    ASSERT_NE(span, nullptr);
+    for(size_t off = 0; off < n; off += Page::SIZE) {
+        ASSERT_EQ(pm.find_span(ptr + off), span);
+    }
+    EXPECT_EQ(pm.find_span(ptr + n - 1), span);
+    mp_free(ptr);
+
+    // 不属于内存池的地址查不到
+    int local = 0;
+    EXPECT_EQ(pm.find_span(&local), nullptr);
+    EXPECT_EQ(pm.find_span(nullptr), nullptr);
+    EXPECT_EQ(pm.find_span(reinterpret_cast<void*>(~size_t(0))), nullptr);
+    EXPECT_GT(pm.node_bytes(), 0);
+}
+
+TEST(memory_pool, span_metadata) {
+    // span 元数据随 span 的创建、合并增减，不经过 malloc
+    auto& ph = SinglePageHeap::get_instance();
+    std::vector<void*> ptrs;
+    for(int i = 0; i < 16; ++i) {
+        ptrs.push_back(mp_malloc(SizeMap::max_size() + 1));
+    }
+    // 每个使用中的 span 都有一份元数据
+    size_t used = ph.metadata_bytes();
+    EXPECT_GE(used, 16 * sizeof(Span));
+    for(auto ptr : ptrs) {
+        mp_free(ptr);
+    }
+    SingleLargeCache::get_instance().flush();
+    // 归还后相邻的空闲 span 合并，元数据随之释放
+    EXPECT_LT(ph.metadata_bytes(), used);
+}
+
+TEST(memory_pool, large_cache) {
+    auto& lc = SingleLargeCache::get_instance();
+    lc.flush();
+    LargeCacheStats before = lc.stats();
+
+    // 反复申请释放大小相近、不超过第一次的 buffer，除第一次外都命中缓存，且复用同一个 span
+    void* first = nullptr;
+    for(int i = 0; i < 100; ++i) {
+        size_t n = (size_t(1) << 20) + (3 - i % 4) * 1000;
+        void* ptr = mp_malloc(n);
+        ASSERT_NE(ptr, nullptr);
+        memset(ptr, 0xff, n);
+        if(first == nullptr) first = ptr;
+        EXPECT_EQ(ptr, first);
+        EXPECT_EQ(SinglePageMap::get_instance().find_span(ptr)->large_bytes(), n);
+        mp_free(ptr);
+    }
+    LargeCacheStats after = lc.stats();
+    EXPECT_EQ(after.misses - before.misses, 1);
+    EXPECT_EQ(after.hits - before.hits, 99);
+    EXPECT_EQ(after.in_use_bytes, before.in_use_bytes);
+    EXPECT_GT(after.cached_bytes, 0);
+
+    // 不同大小各自缓存，每个桶的数量有限
+    std::vector<void*> ptrs;
+    for(size_t mb = 1; mb <= 8; ++mb) {
+        for(int i = 0; i < 8; ++i) {
+            ptrs.push_back(mp_malloc(mb << 20));
+        }
+    }
+    for(auto ptr : ptrs) {
+        mp_free(ptr);
+    }
+    EXPECT_GT(lc.stats().evictions, after.evictions);
+    EXPECT_LE(lc.stats().cached_bytes, size_t(64) << 20);
+
+    // 超过单个 span 上限的 buffer 直接归还给 page heap，不会挤掉已缓存的 span
+    size_t cached = lc.stats().cached_bytes;
+    size_t evictions = lc.stats().evictions;
+    void* big = mp_malloc((size_t(60) << 20) + 1);
+    ASSERT_NE(big, nullptr);
+    mp_free(big);
+    EXPECT_EQ(lc.stats().cached_bytes, cached);
+    EXPECT_EQ(lc.stats().evictions, evictions);
+
+    lc.flush();
+    EXPECT_EQ(lc.stats().cached_bytes, 0);
+}
+
+TEST(memory_pool, hugepage) {
+    auto& ph = SinglePageHeap::get_instance();
+    if(!ph.hugepage_aware()) {
+        GTEST_SKIP() << "hugepage-aware page heap disabled";
+    }
+    auto& lc = SingleLargeCache::get_instance();
+    lc.flush();
+    HugePageStats before = ph.hugepage_stats();
+
+    // 小 span 紧凑地放进 hugepage，不跨越 hugepage 边界
+    constexpr size_t small = 300 << 10;
+    constexpr size_t small_pages = (small + Page::SIZE - 1) / Page::SIZE;
+    std::vector<void*> ptrs;
+    for(int i = 0; i < 4; ++i) {
+        void* ptr = mp_malloc(small);
+        ASSERT_NE(ptr, nullptr);
+        memset(ptr, 0xff, small);
+        Span* span = SinglePageMap::get_instance().find_span(ptr);
+        EXPECT_EQ(span->num_pages(), small_pages);
+        auto start = reinterpret_cast<size_t>(span->start_addr());
+        EXPECT_EQ(start >> Page::HUGE_SHIFT, (start + span->num_bytes() - 1) >> Page::HUGE_SHIFT);
+        ptrs.push_back(ptr);
+    }
+    EXPECT_EQ(ph.hugepage_stats().filler_used_pages - before.filler_used_pages, 4 * small_pages);
+
+    // 中等 span 从 region 中分配，不向上取整到 hugepage
+    constexpr size_t medium = 3 << 20;
+    void* ptr = mp_malloc(medium);
+    ASSERT_NE(ptr, nullptr);
+    memset(ptr, 0xff, medium);
+    EXPECT_GE(ph.hugepage_stats().regions, 1);
+    EXPECT_EQ(ph.hugepage_stats().region_used_pages - before.region_used_pages, medium / Page::SIZE);
+    ptrs.push_back(ptr);
+
+    // 大 span 向上取整到整数个 hugepage
+    constexpr size_t large = 9 << 20;
+    ptr = mp_malloc(large + 1);
+    ASSERT_NE(ptr, nullptr);
+    Span* span = SinglePageMap::get_instance().find_span(ptr);
+    EXPECT_EQ(span->num_pages() % Page::PER_HUGE, 0);
+    EXPECT_EQ(reinterpret_cast<size_t>(span->start_addr()) % Page::HUGE_SIZE, 0);
+    ptrs.push_back(ptr);
+
+    for(auto p : ptrs) {
+        mp_free(p);
+    }
+    lc.flush();
+    HugePageStats after = ph.hugepage_stats();
+    EXPECT_EQ(after.filler_used_pages, before.filler_used_pages);
+    EXPECT_EQ(after.region_used_pages, before.region_used_pages);
+    EXPECT_LE(after.filler_hugepages, before.filler_hugepages);
+}
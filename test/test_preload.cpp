@@ -0,0 +1,114 @@
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <malloc.h>
+#include "gtest/gtest.h"
+#include "size_map.h"
+#include "bootstrap_alloc.h"
+
+// 运行时需要 LD_PRELOAD=libmemorypool.so
+TEST(preload, interposed) {
+    void* ptr = malloc(1000);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(malloc_usable_size(ptr), SizeMap::size(SizeMap::get_size_class(1000)));
+    free(ptr);
+}
+
+TEST(preload, malloc_family) {
+    auto zero = static_cast<unsigned char*>(calloc(100, 3));
+    ASSERT_NE(zero, nullptr);
+    for(int i = 0; i < 300; ++i) {
+        EXPECT_EQ(zero[i], 0);
+    }
+
+    auto ptr = static_cast<unsigned char*>(realloc(zero, 1 << 20));
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(ptr[299], 0);
+    free(ptr);
+
+    void* aligned = nullptr;
+    ASSERT_EQ(posix_memalign(&aligned, 4096, 100), 0);
+    EXPECT_EQ(reinterpret_cast<size_t>(aligned) % 4096, 0);
+    free(aligned);
+    EXPECT_EQ(posix_memalign(&aligned, 12, 100), EINVAL);
+
+    for(void* p : {aligned_alloc(64, 128), memalign(256, 10), valloc(10), pvalloc(10)}) {
+        ASSERT_NE(p, nullptr);
+        free(p);
+    }
+}
+
+TEST(preload, thread_teardown) {
+    // 线程退出时其它 thread_local 对象的析构仍会申请/释放内存
+    struct Holder {
+        std::string str;
+        ~Holder() {
+            std::string temp(1000, 'x');
+            str += temp;
+        }
+    };
+
+    auto work = []() {
+        thread_local Holder holder;
+        holder.str.assign(100, 'y');
+        std::vector<std::string> strs;
+        for(int i = 0; i < 10000; ++i) {
+            strs.emplace_back(i % 500, 'z');
+        }
+    };
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 8; ++i) {
+        threads.emplace_back(work);
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+}
+
+TEST(preload, new_delete) {
+    struct alignas(64) Aligned {
+        char data[100];
+    };
+    auto aligned = new Aligned[3];
+    EXPECT_EQ(reinterpret_cast<size_t>(aligned) % 64, 0);
+    delete[] aligned;
+
+    auto nothrow = new(std::nothrow) char[1 << 20];
+    ASSERT_NE(nothrow, nullptr);
+    delete[] nothrow;
+
+    // sized delete 按字节数归还，之后的申请要能正常复用
+    std::vector<void*> ptrs;
+    for(size_t n = 0; n < 300000; n += 331) {
+        ptrs.push_back(::operator new(n));
+    }
+    for(size_t i = 0; i < ptrs.size(); ++i) {
+        ::operator delete(ptrs[i], i * 331);
+    }
+    for(size_t n = 0; n < 300000; n += 331) {
+        void* ptr = ::operator new(n);
+        EXPECT_GE(malloc_usable_size(ptr), n);
+        ::operator delete(ptr, n);
+    }
+
+    EXPECT_THROW(static_cast<void>(::operator new(size_t(1) << 62)), std::bad_alloc);
+}
+
+TEST(preload, invalid_alignment) {
+    errno = 0;
+    EXPECT_EQ(aligned_alloc(12, 100), nullptr);
+    EXPECT_EQ(errno, EINVAL);
+
+    // 重入或 pool 销毁之后由 bootstrap 分配器服务，同样拒绝不是 2 的幂的对齐
+    auto& ba = SingleBootstrapAlloc::get_instance();
+    errno = 0;
+    EXPECT_EQ(ba.alloc(100, 12), nullptr);
+    EXPECT_EQ(errno, EINVAL);
+    EXPECT_EQ(ba.alloc(100, 0), nullptr);
+
+    void* ptr = ba.alloc(100, 256);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(reinterpret_cast<size_t>(ptr) % 256, 0);
+    ba.dealloc(ptr);
+}